@@ -5,6 +5,7 @@
 #define CSSG_NO_SHORT_NAMES
 #include "cssg.h"
 #include "node.h"
+#include "toml.h"
 
 #include "harness.h"
 #include "cplusplus.h"
@@ -535,6 +536,10 @@ static void render_html(test_batch_runner *runner) {
   free(html);
 
   cssg_node_free(doc);
+
+  OK(runner, cssg_html_template_hash() != 0, "template hash is set");
+  OK(runner, cssg_html_template_hash() == cssg_html_template_hash(),
+     "template hash is stable");
 }
 
 static void render_xml(test_batch_runner *runner) {
@@ -1091,6 +1096,745 @@ static void ref_source_pos(test_batch_runner *runner) {
   cssg_node_free(doc);
 }
 
+static void parse_in_place(test_batch_runner *runner) {
+  // Lines are processed in place, so the block scanners must never write
+  // to the input; a static const buffer may live in read-only memory.
+  static const char markdown[] = "# Heading\n"
+                                 "\n"
+                                 "```c\n"
+                                 "code\n"
+                                 "```\n"
+                                 "<div>\n"
+                                 "html\n"
+                                 "</div>\n"
+                                 "\n"
+                                 "<!-- comment -->\n"
+                                 "Setext\n"
+                                 "------\n"
+                                 "para\r\n"
+                                 "last";
+  cssg_node *doc =
+      cssg_parse_document(markdown, sizeof(markdown) - 1, CSSG_OPT_DEFAULT);
+  char *xml = cssg_render_xml(doc, CSSG_OPT_SOURCEPOS);
+
+  // Feeding one byte at a time forces every line through curline.
+  cssg_parser *parser = cssg_parser_new(CSSG_OPT_DEFAULT);
+  size_t i;
+  for (i = 0; i < sizeof(markdown) - 1; i++)
+    cssg_parser_feed(parser, markdown + i, 1);
+  cssg_node *fed = cssg_parser_finish(parser);
+  cssg_parser_free(parser);
+  char *fed_xml = cssg_render_xml(fed, CSSG_OPT_SOURCEPOS);
+
+  STR_EQ(runner, xml, fed_xml, "in-place lines parse like copied lines");
+  INT_EQ(runner, cssg_node_get_type(cssg_node_first_child(doc)),
+         CSSG_NODE_HEADING, "heading parsed in place");
+
+  free(xml);
+  free(fed_xml);
+  cssg_node_free(doc);
+  cssg_node_free(fed);
+}
+
+static void reference_map(test_batch_runner *runner) {
+  char *markdown = (char *)malloc(200 * 64);
+  size_t len = 0;
+  cssg_node *doc;
+  char *html;
+  int i;
+
+  // Enough definitions to grow the table several times.
+  for (i = 0; i < 200; i++)
+    len += sprintf(markdown + len, "[Label  %d]: /url%d\n", i, i);
+  len += sprintf(markdown + len, "[label 7]: /duplicate\n\n");
+  len += sprintf(markdown + len, "[LABEL 7] [label\n199] [label 200]\n");
+
+  doc = cssg_parse_document(markdown, len, CSSG_OPT_DEFAULT);
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html,
+         "<p><a href=\"/url7\">LABEL 7</a> <a href=\"/url199\">label\n199</a> "
+         "[label 200]</p>\n",
+         "reference lookup folds case and whitespace, first definition wins");
+  free(html);
+  cssg_node_free(doc);
+
+  // Non-ASCII labels, including folds that change length, and an ASCII
+  // run long enough for the bulk lowercase path.
+  len = sprintf(markdown, "[STRASSE \xCE\xA3\xCE\xA3]: /greek\n"
+                          "[ABCDEFGHIJKLMNOPQRSTUVWXYZ]: /alpha\n\n"
+                          "[stra\xE1\xBA\x9E\x65 \xCF\x83\xCF\x82] "
+                          "[abcdefghijklmnopqrstuvwxyz]\n");
+  doc = cssg_parse_document(markdown, len, CSSG_OPT_DEFAULT);
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html,
+         "<p><a href=\"/greek\">stra\xE1\xBA\x9E\x65 \xCF\x83\xCF\x82</a> "
+         "<a href=\"/alpha\">abcdefghijklmnopqrstuvwxyz</a></p>\n",
+         "reference lookup folds Unicode case");
+
+  free(html);
+  free(markdown);
+  cssg_node_free(doc);
+}
+
+static cssg_node *parse_with_shared(const char *markdown,
+                                    const cssg_reference_map *shared) {
+  cssg_parser *parser = cssg_parser_new(CSSG_OPT_DEFAULT);
+  cssg_node *doc;
+
+  cssg_parser_set_shared_references(parser, shared);
+  cssg_parser_feed(parser, markdown, strlen(markdown));
+  doc = cssg_parser_finish(parser);
+  cssg_parser_free(parser);
+  return doc;
+}
+
+static void shared_references(test_batch_runner *runner) {
+  static const char md_path[] = "api_test_links.md";
+  static const char toml_path[] = "api_test_links.toml";
+  static const char markdown[] = "[a] [B] [c]\n\n[b]: /own\n";
+  cssg_reference_map *shared;
+  cssg_node *doc;
+  char *html;
+  FILE *fp;
+
+  fp = fopen(md_path, "wb");
+  fputs("Text is ignored.\n\n[A]: /a \"A\"\n[b]: /b\n", fp);
+  fclose(fp);
+  fp = fopen(toml_path, "wb");
+  fputs("a = \"/a?x=1&y=2\"\n\"C\" = { url = \"/c\", title = \"C\" }\n", fp);
+  fclose(fp);
+
+  shared = cssg_reference_map_load(md_path, CSSG_OPT_DEFAULT);
+  OK(runner, shared != NULL, "load shared references from Markdown");
+  doc = parse_with_shared(markdown, shared);
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html,
+         "<p><a href=\"/a\" title=\"A\">a</a> <a href=\"/own\">B</a> [c]</p>\n",
+         "shared Markdown references are a fallback");
+  free(html);
+  cssg_node_free(doc);
+  cssg_reference_map_free(shared);
+
+  shared = cssg_reference_map_load(toml_path, CSSG_OPT_DEFAULT);
+  OK(runner, shared != NULL, "load shared references from TOML");
+  doc = parse_with_shared(markdown, shared);
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html,
+         "<p><a href=\"/a?x=1&amp;y=2\">a</a> <a href=\"/own\">B</a> "
+         "<a href=\"/c\" title=\"C\">c</a></p>\n",
+         "shared TOML references are a fallback");
+  free(html);
+  cssg_node_free(doc);
+  cssg_reference_map_free(shared);
+
+  remove(md_path);
+  remove(toml_path);
+  OK(runner, cssg_reference_map_load(md_path, CSSG_OPT_DEFAULT) == NULL,
+     "load shared references from a missing file");
+}
+
+static void size_statistics(test_batch_runner *runner) {
+  static const char markdown[] = "Hello *world*\n\n[link](/url \"title\")\n";
+  cssg_node *doc =
+      cssg_parse_document(markdown, sizeof(markdown) - 1, CSSG_OPT_DEFAULT);
+  char *html;
+
+  INT_EQ(runner, doc->as.document.blocks, 2, "stats count blocks");
+  INT_EQ(runner, doc->as.document.inlines, 5, "stats count inlines");
+  INT_EQ(runner, doc->as.document.text_bytes, 15, "stats count text bytes");
+  INT_EQ(runner, doc->as.document.url_bytes, 9, "stats count url bytes");
+
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html, "<p>Hello <em>world</em></p>\n",
+         "render a fragment without stats");
+  free(html);
+  cssg_node_free(doc);
+}
+
+typedef struct {
+  char *data;
+  size_t len;
+  int calls;
+  int fail_at;
+} html_sink;
+
+static int sink_write(const char *data, size_t len, void *userdata) {
+  html_sink *sink = (html_sink *)userdata;
+
+  sink->calls++;
+  if (sink->calls == sink->fail_at)
+    return 7;
+  sink->data = (char *)realloc(sink->data, sink->len + len + 1);
+  memcpy(sink->data + sink->len, data, len);
+  sink->len += len;
+  sink->data[sink->len] = '\0';
+  return 0;
+}
+
+static void render_html_to(test_batch_runner *runner) {
+  static const char line[] = "Some <text> & a [link](/url \"t\")\n";
+  static const char block[] = "\n```\n<code> & \"more\"\n```\n\n";
+  char *markdown = (char *)malloc(2000 * sizeof(line) + 20 * sizeof(block));
+  html_sink sink = {NULL, 0, 0, 0};
+  size_t len = 0;
+  cssg_node *doc;
+  char *html;
+  int i;
+
+  for (i = 0; i < 2000; i++) {
+    memcpy(markdown + len, line, sizeof(line) - 1);
+    len += sizeof(line) - 1;
+    if (i % 100 == 0) {
+      memcpy(markdown + len, block, sizeof(block) - 1);
+      len += sizeof(block) - 1;
+    }
+  }
+  doc = cssg_parse_document(markdown, len, CSSG_OPT_DEFAULT);
+  html = cssg_render_html(doc, CSSG_OPT_DEFAULT);
+
+  INT_EQ(runner, cssg_render_html_to(doc, CSSG_OPT_DEFAULT, sink_write, &sink),
+         0, "cssg_render_html_to succeeds");
+  STR_EQ(runner, sink.data, html,
+         "cssg_render_html_to matches cssg_render_html");
+  OK(runner, sink.calls > 1, "cssg_render_html_to writes in pieces");
+
+  sink.len = 0;
+  sink.calls = 0;
+  sink.fail_at = 2;
+  INT_EQ(runner, cssg_render_html_to(doc, CSSG_OPT_DEFAULT, sink_write, &sink),
+         7, "cssg_render_html_to returns the write error");
+  INT_EQ(runner, sink.calls, 2, "cssg_render_html_to stops after an error");
+
+  free(html);
+  free(sink.data);
+  free(markdown);
+  cssg_node_free(doc);
+}
+
+static void parse_path(test_batch_runner *runner) {
+  static const char markdown[] = "# Title\n\nSome *text*\n- item";
+  static const char path[] = "api_test_parse_path.md";
+  cssg_node *expected =
+      cssg_parse_document(markdown, sizeof(markdown) - 1, CSSG_OPT_DEFAULT);
+  char *expected_xml = cssg_render_xml(expected, CSSG_OPT_DEFAULT);
+  cssg_node *doc;
+  cssg_input input;
+  char *xml;
+  FILE *fp;
+
+  fp = fopen(path, "wb");
+  fwrite(markdown, 1, sizeof(markdown) - 1, fp);
+  fclose(fp);
+
+  INT_EQ(runner, cssg_input_open(&input, path), 0, "cssg_input_open");
+  INT_EQ(runner, (int)input.len, (int)sizeof(markdown) - 1,
+         "cssg_input_open length");
+  OK(runner, memcmp(input.data, markdown, input.len) == 0,
+     "cssg_input_open contents");
+  cssg_input_close(&input);
+
+  doc = cssg_parse_path(path, CSSG_OPT_DEFAULT);
+  xml = cssg_render_xml(doc, CSSG_OPT_DEFAULT);
+  STR_EQ(runner, xml, expected_xml, "cssg_parse_path");
+  free(xml);
+  cssg_node_free(doc);
+
+  // Empty files cannot be mapped and take the read path.
+  fp = fopen(path, "wb");
+  fclose(fp);
+  doc = cssg_parse_path(path, CSSG_OPT_DEFAULT);
+  OK(runner, doc != NULL && cssg_node_first_child(doc) == NULL,
+     "cssg_parse_path empty file");
+  cssg_node_free(doc);
+  remove(path);
+
+  OK(runner, cssg_parse_path(path, CSSG_OPT_DEFAULT) == NULL,
+     "cssg_parse_path missing file");
+
+  free(expected_xml);
+  cssg_node_free(expected);
+}
+
+static void escape_long_text(test_batch_runner *runner) {
+  char markdown[80];
+  char expected[100];
+  int pos;
+
+  // Put an escaped character at every offset of a run long enough to
+  // take the vectorized scan.
+  for (pos = 0; pos < 70; pos++) {
+    memset(markdown, 'a', 70);
+    markdown[pos] = '"';
+    markdown[70] = '\0';
+    snprintf(expected, sizeof(expected), "<p>%.*s&quot;%s</p>\n", pos,
+             markdown, markdown + pos + 1);
+    cssg_node *doc = cssg_parse_document(markdown, 70, CSSG_OPT_DEFAULT);
+    char *html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+    cssg_node_free(doc);
+    if (strcmp(html, expected) != 0) {
+      STR_EQ(runner, html, expected, "escape at offset %d", pos);
+      free(html);
+      return;
+    }
+    free(html);
+  }
+  OK(runner, 1, "escape at every offset of a long run");
+}
+
+static void arena_allocator(test_batch_runner *runner) {
+  static const char markdown[] = "# Title\n"
+                                 "\n"
+                                 "Some *emphasis* and a [link](/url \"title\").\n"
+                                 "\n"
+                                 "- item one\n"
+                                 "- item `two`\n";
+  cssg_mem *arena = cssg_get_arena_mem_allocator();
+  char *expected = cssg_markdown_to_html(markdown, sizeof(markdown) - 1,
+                                          CSSG_OPT_DEFAULT);
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    cssg_parser *parser = cssg_parser_new_with_mem(CSSG_OPT_DEFAULT, arena);
+    cssg_parser_feed(parser, markdown, sizeof(markdown) - 1);
+    cssg_node *doc = cssg_parser_finish(parser);
+    cssg_parser_free(parser);
+
+    OK(runner, doc->mem == arena, "document uses the arena");
+    char *html = cssg_render_html(doc, CSSG_OPT_DEFAULT);
+    STR_EQ(runner, html, expected, "arena document renders the same");
+
+    // Individual frees are no-ops; the reset releases everything.
+    cssg_node_free(doc);
+    cssg_arena_reset();
+  }
+
+  cssg_arena_release();
+  free(expected);
+}
+
+static void parsed_literals(test_batch_runner *runner) {
+  static const char markdown[] = "a *b*<i> c\n";
+  cssg_node *doc =
+      cssg_parse_document(markdown, sizeof(markdown) - 1, CSSG_OPT_DEFAULT);
+  cssg_node *para = cssg_node_first_child(doc);
+  cssg_node *text = cssg_node_first_child(para);
+  cssg_node *html_inline = cssg_node_next(cssg_node_next(text));
+  char *html;
+
+  // Parsed literals may share their node's allocation; replacing them
+  // must not free that storage separately.
+  OK(runner, cssg_node_set_literal(text, "x "), "set_literal on parsed text");
+  OK(runner, cssg_node_set_literal(html_inline, "<b>"),
+     "set_literal on parsed inline HTML");
+  cssg_node_free(cssg_node_last_child(para));
+  cssg_node_append_child(para, cssg_node_new(CSSG_NODE_TEXT));
+  cssg_node_set_literal(cssg_node_last_child(para), " d");
+  cssg_node_insert_after(text, cssg_node_new(CSSG_NODE_TEXT));
+  cssg_node_set_literal(cssg_node_next(text), "y ");
+  cssg_consolidate_text_nodes(doc);
+
+  html = cssg_render_html(para, CSSG_OPT_UNSAFE);
+  STR_EQ(runner, html, "<p>x y <em>b</em><b> d</p>\n",
+         "edited literals render");
+  free(html);
+  cssg_node_free(doc);
+}
+
+static void doc_cache(test_batch_runner *runner) {
+  static const char page_a[] = "# A\n\n\"Quoted\" *text*\n";
+  static const char page_b[] = "# B\n\nOther text\n";
+  cssg_doc_cache *cache = cssg_doc_cache_new(1024 * 1024);
+  cssg_node *doc, *again;
+  char *html;
+
+  doc = cssg_doc_cache_get(cache, page_a, sizeof(page_a) - 1,
+                           CSSG_OPT_DEFAULT);
+  again = cssg_doc_cache_get(cache, page_a, sizeof(page_a) - 1,
+                             CSSG_OPT_SOURCEPOS);
+  OK(runner, again == doc, "sourcepos shares the cached tree");
+  OK(runner, cssg_doc_cache_size(cache) > sizeof(page_a),
+     "cache size counts the document");
+
+  html = cssg_render_html(cssg_node_first_child(again), CSSG_OPT_SOURCEPOS);
+  STR_EQ(runner, html, "<h1 data-sourcepos=\"1:1-1:3\">A</h1>\n",
+         "cached tree keeps source positions");
+  free(html);
+
+  again = cssg_doc_cache_get(cache, page_a, sizeof(page_a) - 1,
+                             CSSG_OPT_SMART);
+  OK(runner, again != doc, "parse options are part of the key");
+  html = cssg_render_html(cssg_node_last_child(again), CSSG_OPT_SMART);
+  STR_EQ(runner, html,
+         "<p>\xE2\x80\x9CQuoted\xE2\x80\x9D <em>text</em></p>\n",
+         "smart document is parsed with SMART");
+  free(html);
+  cssg_doc_cache_free(cache);
+
+  // A budget too small for two documents keeps only the newest.
+  cache = cssg_doc_cache_new(1);
+  doc = cssg_doc_cache_get(cache, page_a, sizeof(page_a) - 1, 0);
+  cssg_doc_cache_get(cache, page_b, sizeof(page_b) - 1, 0);
+  again = cssg_doc_cache_get(cache, page_b, sizeof(page_b) - 1, 0);
+  OK(runner, again != NULL && cssg_node_get_type(again) == CSSG_NODE_DOCUMENT,
+     "newest document is kept over budget");
+  doc = cssg_doc_cache_get(cache, page_a, sizeof(page_a) - 1, 0);
+  html = cssg_render_html(cssg_node_first_child(doc), 0);
+  STR_EQ(runner, html, "<h1>A</h1>\n", "evicted document is parsed again");
+  free(html);
+  cssg_doc_cache_free(cache);
+}
+
+static void fragment_cache(test_batch_runner *runner) {
+  static const char page[] = "# Title\n\nFirst *para*\n\nSecond para\n";
+  static const char edited[] = "# Title\n\nFirst *para*\n\nSecond edit\n";
+  static const char title[] = "# Title\n";
+  static const char changed[] = "# Title\n\n\n\nSecond edit\n";
+  cssg_fragment_cache *cache = cssg_fragment_cache_new(1024 * 1024);
+  cssg_fragment_cache *one;
+  cssg_node *doc = cssg_parse_document(page, sizeof(page) - 1, 0);
+  cssg_node *text;
+  char *html, *expected;
+  size_t size, fragment;
+
+  expected = cssg_render_html(doc, CSSG_OPT_SOURCEPOS);
+  html = cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, cache);
+  STR_EQ(runner, html, expected, "cached render matches cssg_render_html");
+  free(html);
+  size = cssg_fragment_cache_size(cache);
+  OK(runner, size > 0, "rendered blocks are cached");
+
+  html = cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, cache);
+  STR_EQ(runner, html, expected, "render from cache matches");
+  OK(runner, cssg_fragment_cache_size(cache) == size,
+     "unchanged blocks are reused");
+  free(html);
+  free(expected);
+
+  // Changing a node through the API renders its block again.
+  text = cssg_node_first_child(cssg_node_last_child(doc));
+  cssg_node_set_literal(text, "Changed");
+  expected = cssg_render_html(doc, CSSG_OPT_SOURCEPOS);
+  html = cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, cache);
+  STR_EQ(runner, html, expected, "modified block is rendered again");
+  free(html);
+  free(expected);
+  cssg_node_free(doc);
+
+  // An edited document renders only the blocks it changed.  Measure the
+  // cost of the changed paragraph's fragment on the same line, after the
+  // same cached heading.
+  one = cssg_fragment_cache_new(1024 * 1024);
+  doc = cssg_parse_document(title, sizeof(title) - 1, 0);
+  free(cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, one));
+  cssg_node_free(doc);
+  fragment = cssg_fragment_cache_size(one);
+  doc = cssg_parse_document(changed, sizeof(changed) - 1, 0);
+  free(cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, one));
+  cssg_node_free(doc);
+  fragment = cssg_fragment_cache_size(one) - fragment;
+  cssg_fragment_cache_free(one);
+
+  doc = cssg_parse_document(edited, sizeof(edited) - 1, 0);
+  size = cssg_fragment_cache_size(cache);
+  expected = cssg_render_html(doc, CSSG_OPT_SOURCEPOS);
+  html = cssg_render_html_cached(doc, CSSG_OPT_SOURCEPOS, cache);
+  STR_EQ(runner, html, expected, "edited document renders the same");
+  OK(runner, cssg_fragment_cache_size(cache) == size + fragment,
+     "only the edited block is added");
+  free(html);
+  free(expected);
+  cssg_node_free(doc);
+  cssg_fragment_cache_free(cache);
+}
+
+static void reparse_range(test_batch_runner *runner) {
+  static const char old_text[] =
+      "# Title\n\nFirst para\n\n- item\n\nLast para\n";
+  static const char new_text[] =
+      "# Title\n\nFirst\nedited para\n\n- item\n\nLast para\n";
+  static const char refs_text[] = "[a]\n\n[a]: /url\n";
+  int options = CSSG_OPT_SOURCEPOS;
+  cssg_node *doc = cssg_parse_document(old_text, sizeof(old_text) - 1,
+                                       options);
+  cssg_node *title = cssg_node_first_child(doc);
+  cssg_node *last = cssg_node_last_child(doc);
+  cssg_node *fresh;
+  char *html, *expected;
+  int result;
+
+  // Replace the space in "First para" with "\nedited ".
+  result = cssg_parser_reparse_range(doc, old_text, sizeof(old_text) - 1,
+                                     new_text, sizeof(new_text) - 1, 14, 1,
+                                     options);
+  INT_EQ(runner, result, 1, "reparse_range keeps blocks");
+  OK(runner, cssg_node_first_child(doc) == title,
+     "block before the edit is kept");
+  OK(runner, cssg_node_last_child(doc) == last, "block after the edit is kept");
+  INT_EQ(runner, cssg_node_get_start_line(last), 8,
+         "kept block is moved down a line");
+
+  fresh = cssg_parse_document(new_text, sizeof(new_text) - 1, options);
+  expected = cssg_render_xml(fresh, options);
+  html = cssg_render_xml(doc, options);
+  STR_EQ(runner, html, expected, "reparsed tree matches a full parse");
+  free(html);
+  free(expected);
+  cssg_node_free(fresh);
+
+  INT_EQ(runner,
+         cssg_parser_reparse_range(doc, new_text, sizeof(new_text) - 1,
+                                   old_text, sizeof(old_text) - 1, 14, 100,
+                                   options),
+         -1, "reparse_range rejects an edit past the end");
+  cssg_node_free(doc);
+
+  // Reference definitions can affect any block.
+  doc = cssg_parse_document(refs_text, 3, options);
+  result = cssg_parser_reparse_range(doc, refs_text, 3, refs_text,
+                                     sizeof(refs_text) - 1, 3,
+                                     0, options);
+  INT_EQ(runner, result, 0, "reference definitions reparse everything");
+  html = cssg_render_html(cssg_node_first_child(doc), 0);
+  STR_EQ(runner, html, "<p><a href=\"/url\">a</a></p>\n",
+         "added reference definition is used");
+  free(html);
+  cssg_node_free(doc);
+}
+
+static void front_matter(test_batch_runner *runner) {
+  static const char text[] = "+++\ntitle = \"T\"\n+++\n# H\n";
+  static const char edited[] = "+++\ntitle = \"U\"\n+++\n# H\n";
+  static const char unterminated[] = "+++\ntitle\n";
+  int options = CSSG_OPT_FRONT_MATTER;
+  cssg_node *doc = cssg_parse_document(text, sizeof(text) - 1, options);
+  toml_table_t *table = cssg_node_get_front_matter(doc);
+  cssg_parser *parser;
+  const toml_value_t *value;
+  toml_datum_t title;
+  char *html;
+
+  OK(runner, table != NULL, "front matter is parsed");
+  title = toml_string_in(table, "title");
+  OK(runner, title.ok && strcmp(title.u.s, "T") == 0,
+     "front matter value is read");
+  free(title.u.s);
+  INT_EQ(runner, cssg_node_get_start_line(cssg_node_first_child(doc)), 4,
+         "first block follows the front matter");
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html, "<h1>H</h1>\n", "front matter is not rendered");
+  free(html);
+
+  cssg_parser_reparse_range(doc, text, sizeof(text) - 1, edited,
+                            sizeof(edited) - 1, 13, 1, options);
+  title = toml_string_in(cssg_node_get_front_matter(doc), "title");
+  OK(runner, title.ok && strcmp(title.u.s, "U") == 0,
+     "reparse_range updates the front matter");
+  free(title.u.s);
+  cssg_node_free(doc);
+
+  doc = cssg_parse_document(unterminated, sizeof(unterminated) - 1, options);
+  OK(runner, cssg_node_get_front_matter(doc) == NULL,
+     "unterminated front matter is ignored");
+  html = cssg_render_html(cssg_node_first_child(doc), CSSG_OPT_DEFAULT);
+  STR_EQ(runner, html, "<p>+++\ntitle</p>\n",
+         "unterminated front matter is parsed as Markdown");
+  free(html);
+  cssg_node_free(doc);
+
+  doc = cssg_parse_document(text, sizeof(text) - 1, CSSG_OPT_DEFAULT);
+  OK(runner, cssg_node_get_front_matter(doc) == NULL,
+     "front matter needs CSSG_OPT_FRONT_MATTER");
+  cssg_node_free(doc);
+
+  // With the arena allocator, the reset releases the front matter too.
+  parser = cssg_parser_new_with_mem(options, cssg_get_arena_mem_allocator());
+  cssg_parser_feed(parser, text, sizeof(text) - 1);
+  doc = cssg_parser_finish(parser);
+  cssg_parser_free(parser);
+  value = toml_value_in(cssg_node_get_front_matter(doc), "title");
+  OK(runner, value && value->type == 's' && strcmp(value->u.s, "T") == 0,
+     "front matter is read from the arena");
+  cssg_arena_reset();
+  cssg_arena_release();
+}
+
+static void toml_lookup(test_batch_runner *runner) {
+  char conf[8192], line[64], errbuf[100];
+  size_t len = 0;
+  toml_table_t *tab;
+  int i, found = 0;
+
+  // Enough keys of each kind for the root table to be indexed.
+  for (i = 0; i < 100; i++)
+    len += snprintf(conf + len, sizeof(conf) - len, "v%d = %d\na%d = [%d]\n",
+                    i, i, i, i);
+  for (i = 0; i < 100; i++)
+    len += snprintf(conf + len, sizeof(conf) - len, "[t%d]\n", i);
+  len += snprintf(conf + len, sizeof(conf) - len, "[x.y]\n[x]\n");
+  tab = toml_parse(conf, errbuf, sizeof(errbuf));
+  OK(runner, tab != NULL, "toml_parse with many keys");
+
+  for (i = 0; tab && i < 100; i++) {
+    toml_datum_t v;
+    snprintf(line, sizeof(line), "v%d", i);
+    v = toml_int_in(tab, line);
+    found += v.ok && v.u.i == i && !toml_array_in(tab, line);
+    snprintf(line, sizeof(line), "a%d", i);
+    found += toml_array_in(tab, line) != NULL && !toml_raw_in(tab, line);
+    snprintf(line, sizeof(line), "t%d", i);
+    found += toml_table_in(tab, line) != NULL && toml_key_exists(tab, line);
+  }
+  INT_EQ(runner, found, 300, "every key is found with its kind");
+  OK(runner, tab && !toml_key_exists(tab, "v100"), "missing key is absent");
+  OK(runner, tab && toml_table_in(toml_table_in(tab, "x"), "y") != NULL,
+     "implicit table is found");
+  toml_free(tab);
+
+  snprintf(conf + len, sizeof(conf) - len, "[t42]\n");
+  tab = toml_parse(conf, errbuf, sizeof(errbuf));
+  OK(runner, tab == NULL && strstr(errbuf, "key exists") != NULL,
+     "duplicate key in an indexed table is an error");
+  toml_free(tab);
+}
+
+static void toml_read_file(test_batch_runner *runner) {
+  char errbuf[100];
+  toml_table_t *tab;
+  toml_array_t *items;
+  toml_datum_t datum;
+  FILE *fp;
+  int i;
+
+  fp = tmpfile();
+  OK(runner, fp != NULL, "tmpfile for toml_parse_file");
+  if (fp == NULL)
+    return;
+  fputs("items = [", fp);
+  for (i = 0; i < 1000; i++)
+    fprintf(fp, "%d, ", i);
+  fputs("]\nlong = \"", fp);
+  for (i = 0; i < 1000; i++)
+    fputs("0123456789", fp);
+  fputs("\"\n", fp);
+  rewind(fp);
+
+  tab = toml_parse_file(fp, errbuf, sizeof(errbuf));
+  fclose(fp);
+  OK(runner, tab != NULL, "toml_parse_file");
+  if (tab == NULL)
+    return;
+
+  items = toml_array_in(tab, "items");
+  datum = toml_int_at(items, 999);
+  OK(runner, toml_array_nelem(items) == 1000 && datum.ok && datum.u.i == 999,
+     "long array is read in full");
+  datum = toml_string_in(tab, "long");
+  OK(runner, datum.ok && strlen(datum.u.s) == 10000,
+     "long string is read in full");
+  free(datum.u.s);
+  toml_free(tab);
+}
+
+static void toml_inplace(test_batch_runner *runner) {
+  char conf[] = "a = 1\n\"q\\tk\" = 'x'\n[t]\nb = [\"s\", 2]\n";
+  char errbuf[100];
+  toml_table_t *tab = toml_parse_inplace(conf, errbuf, sizeof(errbuf));
+  toml_table_t *t;
+  const char *raw;
+  toml_datum_t datum;
+
+  OK(runner, tab != NULL, "toml_parse_inplace");
+  if (tab == NULL)
+    return;
+
+  raw = toml_raw_in(tab, "a");
+  OK(runner, raw == conf + 4 && strcmp(raw, "1") == 0,
+     "raw value is left in the source");
+  OK(runner, toml_key_in(tab, 0) == conf, "key is left in the source");
+  datum = toml_string_in(tab, "q\tk");
+  OK(runner, datum.ok && strcmp(datum.u.s, "x") == 0,
+     "escaped key is found");
+  free(datum.u.s);
+  t = toml_table_in(tab, "t");
+  datum = toml_string_at(toml_array_in(t, "b"), 0);
+  OK(runner, datum.ok && strcmp(datum.u.s, "s") == 0,
+     "array value is read");
+  free(datum.u.s);
+  datum = toml_int_at(toml_array_in(t, "b"), 1);
+  OK(runner, datum.ok && datum.u.i == 2, "last array value is read");
+  toml_free(tab);
+
+  strcpy(conf, "a = 1\na = 2\n");
+  OK(runner, toml_parse_inplace(conf, errbuf, sizeof(errbuf)) == NULL &&
+                 strcmp(errbuf, "line 2: key exists") == 0,
+     "toml_parse_inplace reports errors");
+}
+
+static void toml_decode_values(test_batch_runner *runner, toml_table_t *tab,
+                               const char *mode) {
+  const toml_value_t *v;
+  const toml_array_t *arr;
+
+  OK(runner, toml_value_in(tab, "s") == NULL, "%s: not decoded yet", mode);
+  OK(runner, toml_decode(tab) == 0, "%s: toml_decode", mode);
+  OK(runner, toml_decode(tab) == 0, "%s: toml_decode twice", mode);
+
+  v = toml_value_in(tab, "s");
+  OK(runner, v && v->type == 's' && strcmp(v->u.s, "a\tb") == 0,
+     "%s: string is decoded", mode);
+  OK(runner, toml_value_in(tab, "s") == v, "%s: value is kept", mode);
+  v = toml_value_in(tab, "i");
+  OK(runner, v && v->type == 'i' && v->u.i == -42, "%s: int", mode);
+  v = toml_value_in(tab, "d");
+  OK(runner, v && v->type == 'd' && v->u.d == 1.5, "%s: double", mode);
+  v = toml_value_in(tab, "b");
+  OK(runner, v && v->type == 'b' && v->u.b == 1, "%s: bool", mode);
+  v = toml_value_in(tab, "ts");
+  OK(runner,
+     v && v->type == 'T' && *v->u.ts->year == 2020 &&
+         *v->u.ts->second == 5 && strcmp(v->u.ts->z, "Z") == 0,
+     "%s: timestamp", mode);
+  v = toml_value_in(tab, "day");
+  OK(runner, v && v->type == 'D' && *v->u.ts->day == 9 && !v->u.ts->hour,
+     "%s: date", mode);
+
+  arr = toml_array_in(toml_table_in(tab, "t"), "a");
+  v = toml_value_at(arr, 1);
+  OK(runner, v && v->type == 's' && strcmp(v->u.s, "y") == 0,
+     "%s: array value is decoded", mode);
+  OK(runner, toml_value_at(arr, 2) == NULL, "%s: array index past end", mode);
+  v = toml_value_in(toml_table_at(toml_array_in(tab, "p"), 1), "n");
+  OK(runner, v && v->type == 'i' && v->u.i == 2,
+     "%s: value in array of tables", mode);
+  OK(runner, toml_value_in(tab, "t") == NULL, "%s: table is not a value",
+     mode);
+  OK(runner, toml_value_in(tab, "missing") == NULL, "%s: missing key", mode);
+}
+
+static void toml_decode_test(test_batch_runner *runner) {
+  static const char src[] =
+      "s = \"a\\tb\"\ni = -42\nd = 1.5\nb = true\n"
+      "ts = 2020-01-02T03:04:05Z\nday = 2021-08-09\n"
+      "[t]\na = ['x', 'y']\n[[p]]\nn = 1\n[[p]]\nn = 2\n";
+  char conf[sizeof(src)];
+  toml_table_t *tab;
+
+  memcpy(conf, src, sizeof(src));
+  tab = toml_parse(conf, NULL, 0);
+  OK(runner, tab != NULL, "toml_parse");
+  if (tab) {
+    toml_decode_values(runner, tab, "copy");
+    toml_free(tab);
+  }
+
+  tab = toml_parse_inplace(conf, NULL, 0);
+  OK(runner, tab != NULL, "toml_parse_inplace");
+  if (tab) {
+    toml_decode_values(runner, tab, "in place");
+    toml_free(tab);
+  }
+}
+
 int main(void) {
   int retval;
   test_batch_runner *runner = test_batch_runner_new();
@@ -1120,6 +1864,23 @@ int main(void) {
   source_pos(runner);
   source_pos_inlines(runner);
   ref_source_pos(runner);
+  parse_in_place(runner);
+  parse_path(runner);
+  size_statistics(runner);
+  reference_map(runner);
+  shared_references(runner);
+  render_html_to(runner);
+  escape_long_text(runner);
+  arena_allocator(runner);
+  parsed_literals(runner);
+  doc_cache(runner);
+  fragment_cache(runner);
+  reparse_range(runner);
+  front_matter(runner);
+  toml_lookup(runner);
+  toml_read_file(runner);
+  toml_inplace(runner);
+  toml_decode_test(runner);
 
   test_print_summary(runner);
   retval = test_ok(runner) ? 0 : 1;
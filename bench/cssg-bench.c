@@ -0,0 +1,128 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "cssg.h"
+
+// Times the library's phases on each input file, independent of
+// process startup and I/O:
+//
+//   cssg-bench [--phase parse|html] [--iterations N] FILE...
+//
+// 'parse' times cssg_parse_document; 'html' parses once and times
+// cssg_render_html.  Results are reported in MB of Markdown input per
+// CPU second.
+
+typedef enum { PHASE_PARSE, PHASE_HTML } bench_phase;
+
+static void print_usage(void) {
+  printf("Usage:   cssg-bench [--phase parse|html] [--iterations N] "
+         "FILE...\n");
+}
+
+static char *read_file(const char *path, size_t *len) {
+  FILE *fp = fopen(path, "rb");
+  char *data;
+  long size;
+
+  if (fp == NULL)
+    return NULL;
+  if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) < 0 ||
+      fseek(fp, 0, SEEK_SET) != 0) {
+    fclose(fp);
+    return NULL;
+  }
+  data = (char *)malloc(size ? (size_t)size : 1);
+  if (data == NULL || fread(data, 1, (size_t)size, fp) != (size_t)size) {
+    free(data);
+    fclose(fp);
+    return NULL;
+  }
+  fclose(fp);
+  *len = (size_t)size;
+  return data;
+}
+
+static double bench_file(const char *data, size_t len, bench_phase phase,
+                         int iterations) {
+  cssg_node *doc = NULL;
+  clock_t start;
+  double seconds;
+  int i;
+
+  if (phase == PHASE_HTML)
+    doc = cssg_parse_document(data, len, CSSG_OPT_DEFAULT);
+
+  start = clock();
+  for (i = 0; i < iterations; i++) {
+    if (phase == PHASE_PARSE) {
+      cssg_node_free(cssg_parse_document(data, len, CSSG_OPT_DEFAULT));
+    } else {
+      free(cssg_render_html(doc, CSSG_OPT_DEFAULT));
+    }
+  }
+  seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+  if (doc)
+    cssg_node_free(doc);
+  return seconds;
+}
+
+int main(int argc, char *argv[]) {
+  bench_phase phase = PHASE_HTML;
+  int iterations = 200;
+  double total_bytes = 0, total_seconds = 0;
+  int i;
+
+  for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+    if (strcmp(argv[i], "--phase") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "parse") == 0) {
+        phase = PHASE_PARSE;
+      } else if (strcmp(argv[i], "html") == 0) {
+        phase = PHASE_HTML;
+      } else {
+        print_usage();
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      iterations = atoi(argv[++i]);
+      if (iterations < 1) {
+        print_usage();
+        return 1;
+      }
+    } else {
+      print_usage();
+      return 1;
+    }
+  }
+
+  if (i == argc) {
+    print_usage();
+    return 1;
+  }
+
+  for (; i < argc; i++) {
+    size_t len;
+    char *data = read_file(argv[i], &len);
+    const char *name = strrchr(argv[i], '/');
+    double seconds;
+
+    if (data == NULL) {
+      fprintf(stderr, "Error reading file %s\n", argv[i]);
+      return 1;
+    }
+
+    seconds = bench_file(data, len, phase, iterations);
+    printf("%26s  %9.2f MB/s\n", name ? name + 1 : argv[i],
+           seconds > 0 ? len * (double)iterations / seconds / 1e6 : 0.0);
+    total_bytes += (double)len * iterations;
+    total_seconds += seconds;
+    free(data);
+  }
+
+  printf("%26s  %9.2f MB/s\n", "total",
+         total_seconds > 0 ? total_bytes / total_seconds / 1e6 : 0.0);
+  return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "cssg.h"
+
+// Bump allocator backing cssg_get_arena_mem_allocator().
+//
+// Memory is carved out of large chunks; 'free' is a no-op and
+// everything is released at once by cssg_arena_reset().  Each
+// allocation is preceded by a header holding its size so 'realloc' can
+// copy the old contents, and the most recent allocation is grown in
+// place when its chunk has room, which keeps cssg_strbuf appends cheap.
+//
+// cssg_mem carries no context pointer, so the arena state is kept per
+// thread.  Documents parsed with the arena must be used and reset on
+// the thread that parsed them.
+
+#if defined(_MSC_VER)
+#define CSSG_THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define CSSG_THREAD_LOCAL __thread
+#else
+#define CSSG_THREAD_LOCAL _Thread_local
+#endif
+
+#define ARENA_ALIGN (2 * sizeof(void *))
+#define ARENA_ALIGN_UP(n) (((n) + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1))
+#define ARENA_HEADER ARENA_ALIGN_UP(sizeof(size_t))
+#define ARENA_MIN_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (16 * 1024 * 1024)
+
+typedef struct arena_chunk {
+  struct arena_chunk *prev;
+  size_t size;
+  size_t used;
+  unsigned char *last; // Most recent allocation, or NULL.
+  unsigned char data[];
+} arena_chunk;
+
+static CSSG_THREAD_LOCAL arena_chunk *A = NULL;
+
+static arena_chunk *alloc_chunk(size_t size, arena_chunk *prev) {
+  arena_chunk *c = (arena_chunk *)malloc(sizeof(arena_chunk) + size);
+  if (!c) {
+    fprintf(stderr, "[cssg] arena chunk allocation failed, aborting\n");
+    abort();
+  }
+  c->prev = prev;
+  c->size = size;
+  c->used = 0;
+  c->last = NULL;
+  return c;
+}
+
+static unsigned char *arena_alloc(size_t size) {
+  size_t need;
+  unsigned char *block;
+
+  if (size > ARENA_MAX_CHUNK * (size_t)64) {
+    fprintf(stderr, "[cssg] arena allocation too large, aborting\n");
+    abort();
+  }
+
+  need = ARENA_HEADER + ARENA_ALIGN_UP(size);
+  if (!A || A->size - A->used < need) {
+    size_t chunk_size = A ? A->size * 2 : ARENA_MIN_CHUNK;
+    if (chunk_size > ARENA_MAX_CHUNK)
+      chunk_size = ARENA_MAX_CHUNK;
+    if (chunk_size < need)
+      chunk_size = need;
+    A = alloc_chunk(chunk_size, A);
+  }
+
+  block = A->data + A->used;
+  *(size_t *)block = size;
+  A->used += need;
+  A->last = block + ARENA_HEADER;
+  return A->last;
+}
+
+static void *arena_calloc(size_t nmem, size_t size) {
+  unsigned char *ptr;
+
+  if (size && nmem > (size_t)-1 / size) {
+    fprintf(stderr, "[cssg] arena calloc overflow, aborting\n");
+    abort();
+  }
+  ptr = arena_alloc(nmem * size);
+  memset(ptr, 0, nmem * size);
+  return ptr;
+}
+
+static void *arena_realloc(void *ptr, size_t size) {
+  unsigned char *p = (unsigned char *)ptr;
+  unsigned char *new_ptr;
+  size_t old_size;
+
+  if (!p)
+    return arena_alloc(size);
+
+  old_size = *(size_t *)(p - ARENA_HEADER);
+
+  // Grow or shrink the last allocation of the current chunk in place.
+  if (p == A->last) {
+    size_t start = (size_t)(p - A->data) - ARENA_HEADER;
+    size_t need = ARENA_HEADER + ARENA_ALIGN_UP(size);
+    if (A->size - start >= need) {
+      *(size_t *)(p - ARENA_HEADER) = size;
+      A->used = start + need;
+      return p;
+    }
+  }
+
+  new_ptr = arena_alloc(size);
+  memcpy(new_ptr, p, old_size < size ? old_size : size);
+  return new_ptr;
+}
+
+static void arena_free(void *ptr) { (void)ptr; }
+
+static cssg_mem CSSG_ARENA_MEM_ALLOCATOR = {arena_calloc, arena_realloc,
+                                            arena_free};
+
+cssg_mem *cssg_get_arena_mem_allocator(void) {
+  return &CSSG_ARENA_MEM_ALLOCATOR;
+}
+
+void cssg_arena_reset(void) {
+  arena_chunk *keep = A;
+  arena_chunk *c;
+
+  if (!A)
+    return;
+
+  // Keep the largest chunk for the next document and release the rest.
+  for (c = A->prev; c; c = c->prev) {
+    if (c->size > keep->size)
+      keep = c;
+  }
+  while (A) {
+    c = A->prev;
+    if (A != keep)
+      free(A);
+    A = c;
+  }
+  keep->prev = NULL;
+  keep->used = 0;
+  keep->last = NULL;
+  A = keep;
+}
+
+void cssg_arena_release(void) {
+  while (A) {
+    arena_chunk *prev = A->prev;
+    free(A);
+    A = prev;
+  }
+}
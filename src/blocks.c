@@ -10,11 +10,13 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "cssg_ctype.h"
 #include "parser.h"
 #include "cssg.h"
 #include "node.h"
+#include "iterator.h"
 #include "references.h"
 #include "utf8.h"
 #include "scanners.h"
@@ -22,6 +24,7 @@
 #include "houdini.h"
 #include "buffer.h"
 #include "chunk.h"
+#include "simd.h"
 
 #define CODE_INDENT 4
 #define TAB_STOP 4
@@ -67,16 +70,19 @@ static void S_parser_feed(cssg_parser *parser, const unsigned char *buffer,
                           size_t len, bool eof);
 
 static void S_process_line(cssg_parser *parser, const unsigned char *buffer,
-                           bufsize_t bytes);
+                           bufsize_t bytes, bool borrow);
 
+// Top-level blocks keep a content hash; see cssg_node_block_key().
 static cssg_node *make_block(cssg_mem *mem, cssg_node_type tag,
-                              int start_line, int start_column) {
-  cssg_node *e;
+                              int start_line, int start_column,
+                              bool top_level) {
+  cssg_node *e = (cssg_node *)mem->calloc(1, sizeof(cssg_node));
 
-  e = (cssg_node *)mem->calloc(1, sizeof(*e));
   e->mem = mem;
   e->type = (uint16_t)tag;
   e->flags = CSSG_NODE__OPEN;
+  if (top_level)
+    e->flags |= CSSG_NODE__BLOCK_HASH;
   e->start_line = start_line;
   e->start_column = start_column;
   e->end_line = start_line;
@@ -86,7 +92,7 @@ static cssg_node *make_block(cssg_mem *mem, cssg_node_type tag,
 
 // Create a root document node.
 static cssg_node *make_document(cssg_mem *mem) {
-  cssg_node *e = make_block(mem, CSSG_NODE_DOCUMENT, 1, 1);
+  cssg_node *e = make_block(mem, CSSG_NODE_DOCUMENT, 1, 1, false);
   return e;
 }
 
@@ -97,6 +103,7 @@ cssg_parser *cssg_parser_new_with_mem_into_root(int options, cssg_mem *mem, cssg
   cssg_strbuf_init(mem, &parser->curline, 256);
   cssg_strbuf_init(mem, &parser->linebuf, 0);
   cssg_strbuf_init(mem, &parser->content, 0);
+  cssg_strbuf_init(mem, &parser->front_matter_lines, 0);
 
   root->flags = CSSG_NODE__OPEN;
 
@@ -133,6 +140,7 @@ void cssg_parser_free(cssg_parser *parser) {
   cssg_mem *mem = parser->mem;
   cssg_strbuf_free(&parser->curline);
   cssg_strbuf_free(&parser->linebuf);
+  cssg_strbuf_free(&parser->front_matter_lines);
   cssg_reference_map_free(parser->refmap);
   mem->free(parser);
 }
@@ -264,7 +272,7 @@ static cssg_node *finalize(cssg_parser *parser, cssg_node *b) {
          CSSG_NODE__OPEN); // shouldn't call finalize on closed blocks
   b->flags &= ~CSSG_NODE__OPEN;
 
-  if (parser->curline.size == 0) {
+  if (parser->line.len == 0) {
     // end of input - line number has not been incremented
     b->end_line = parser->line_number;
     b->end_column = parser->last_line_length;
@@ -272,10 +280,10 @@ static cssg_node *finalize(cssg_parser *parser, cssg_node *b) {
              (S_type(b) == CSSG_NODE_CODE_BLOCK && b->as.code.fenced) ||
              (S_type(b) == CSSG_NODE_HEADING && b->as.heading.setext)) {
     b->end_line = parser->line_number;
-    b->end_column = parser->curline.size;
-    if (b->end_column && parser->curline.ptr[b->end_column - 1] == '\n')
+    b->end_column = parser->line.len;
+    if (b->end_column && parser->line.data[b->end_column - 1] == '\n')
       b->end_column -= 1;
-    if (b->end_column && parser->curline.ptr[b->end_column - 1] == '\r')
+    if (b->end_column && parser->line.data[b->end_column - 1] == '\r')
       b->end_column -= 1;
   } else {
     b->end_line = parser->line_number - 1;
@@ -384,7 +392,8 @@ static cssg_node *add_child(cssg_parser *parser, cssg_node *parent,
   }
 
   cssg_node *child =
-      make_block(parser->mem, block_type, parser->line_number, start_column);
+      make_block(parser->mem, block_type, parser->line_number, start_column,
+                 parent == parser->root);
   child->parent = parent;
 
   if (parent->last_child) {
@@ -398,27 +407,76 @@ static cssg_node *add_child(cssg_parser *parser, cssg_node *parent,
   return child;
 }
 
+static inline bufsize_t S_add_size(bufsize_t total, size_t n) {
+  return n > (size_t)(INT32_MAX - total) ? INT32_MAX : total + (bufsize_t)n;
+}
+
+static void S_count_node(cssg_document *stats, cssg_node *node) {
+  if (node->type >= CSSG_NODE_FIRST_INLINE)
+    stats->inlines++;
+  else
+    stats->blocks++;
+
+  stats->text_bytes = S_add_size(stats->text_bytes, (size_t)node->len);
+  if (node->type == CSSG_NODE_LINK || node->type == CSSG_NODE_IMAGE) {
+    if (node->as.link.url)
+      stats->url_bytes = S_add_size(stats->url_bytes,
+                                    strlen((char *)node->as.link.url));
+    if (node->as.link.title)
+      stats->url_bytes = S_add_size(stats->url_bytes,
+                                    strlen((char *)node->as.link.title));
+  }
+}
+
+// Count the descendants of 'root'.
+static void S_count_subtree(cssg_document *stats, cssg_node *root) {
+  cssg_node *node = root->first_child;
+
+  while (node) {
+    S_count_node(stats, node);
+    if (node->first_child) {
+      node = node->first_child;
+      continue;
+    }
+    while (node != root && !node->next)
+      node = node->parent;
+    node = node == root ? NULL : node->next;
+  }
+}
+
 // Walk through node and all children, recursively, parsing
-// string content into inline content where appropriate.
+// string content into inline content where appropriate.  If 'stats' is
+// not NULL, also record size statistics for the renderers: blocks as
+// they are visited, inlines right after they are parsed.
 static void process_inlines(cssg_mem *mem, cssg_node *root,
-                            cssg_reference_map *refmap, int options) {
-  cssg_iter *iter = cssg_iter_new(root);
+                            cssg_reference_map *refmap, int options,
+                            cssg_document *stats) {
+  cssg_iter iter;
   cssg_node *cur;
   cssg_event_type ev_type;
 
-  while ((ev_type = cssg_iter_next(iter)) != CSSG_EVENT_DONE) {
-    cur = cssg_iter_get_node(iter);
+  // Only the counters: a document's front matter is kept.
+  if (stats) {
+    stats->text_bytes = stats->url_bytes = 0;
+    stats->blocks = stats->inlines = 0;
+  }
+
+  cssg_iter_init(&iter, root);
+  while ((ev_type = cssg_iter_step(&iter)) != CSSG_EVENT_DONE) {
+    cur = iter.cur.node;
     if (ev_type == CSSG_EVENT_ENTER) {
       if (contains_inlines(S_type(cur))) {
         cssg_parse_inlines(mem, cur, refmap, options);
         mem->free(cur->data);
         cur->data = NULL;
         cur->len = 0;
+        if (stats)
+          S_count_subtree(stats, cur);
       }
+      if (stats && cur != root)
+        S_count_node(stats, cur);
     }
   }
-
-  cssg_iter_free(iter);
 }
 
 // Attempts to parse a list item marker (bullet or enumerated).
@@ -532,7 +590,10 @@ static cssg_node *finalize_document(cssg_parser *parser) {
   else
     parser->refmap->max_ref_size = 100000;
 
-  process_inlines(parser->mem, parser->root, parser->refmap, parser->options);
+  process_inlines(parser->mem, parser->root, parser->refmap, parser->options,
+                  parser->root->type == CSSG_NODE_DOCUMENT
+                      ? &parser->root->as.document
+                      : NULL);
 
   cssg_strbuf_free(&parser->content);
 
@@ -558,6 +619,31 @@ cssg_node *cssg_parse_file(FILE *f, int options) {
   return document;
 }
 
+cssg_node *cssg_parse_path_with_mem(const char *path, int options,
+                                    cssg_mem *mem) {
+  cssg_input input;
+  cssg_parser *parser;
+  cssg_node *document;
+
+  if (cssg_input_open(&input, path) != 0)
+    return NULL;
+
+  // The whole file is one buffer, so every line but the last is
+  // processed straight out of the mapping.
+  parser = cssg_parser_new_with_mem(options, mem);
+  S_parser_feed(parser, (const unsigned char *)input.data, input.len, true);
+  document = cssg_parser_finish(parser);
+  cssg_parser_free(parser);
+
+  cssg_input_close(&input);
+  return document;
+}
+
+cssg_node *cssg_parse_path(const char *path, int options) {
+  return cssg_parse_path_with_mem(path, options,
+                                  cssg_get_default_mem_allocator());
+}
+
 cssg_node *cssg_parse_document(const char *buffer, size_t len, int options) {
   cssg_parser *parser = cssg_parser_new(options);
   cssg_node *document;
@@ -573,6 +659,25 @@ void cssg_parser_feed(cssg_parser *parser, const char *buffer, size_t len) {
   S_parser_feed(parser, (const unsigned char *)buffer, len, false);
 }
 
+/* "\0\n\r", generated by tools/make_byteset.py */
+static const cssg_byteset LINE_END_CHARS = {
+    {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x01, 0x00, 0x00, 0x01, 0x00, 0x00},
+    {0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+// Returns a pointer to the first '\r', '\n' or NUL in [p, end), or end.
+static const unsigned char *S_find_line_end(const unsigned char *p,
+                                            const unsigned char *end) {
+  for (;;) {
+    bufsize_t n = end - p > INT32_MAX ? INT32_MAX : (bufsize_t)(end - p);
+    bufsize_t i = cssg_byteset_find(&LINE_END_CHARS, p, n);
+    if (i < n || p + n == end)
+      return p + i;
+    p += n;
+  }
+}
+
 static void S_parser_feed(cssg_parser *parser, const unsigned char *buffer,
                           size_t len, bool eof) {
   const unsigned char *end = buffer + len;
@@ -597,16 +702,9 @@ static void S_parser_feed(cssg_parser *parser, const unsigned char *buffer,
   while (buffer < end) {
     const unsigned char *eol;
     bufsize_t chunk_len;
-    bool process = false;
-    for (eol = buffer; eol < end; ++eol) {
-      if (S_is_line_end_char(*eol)) {
-        process = true;
-        break;
-      }
-      if (*eol == '\0' && eol < end) {
-        break;
-      }
-    }
+    bool process;
+    eol = S_find_line_end(buffer, end);
+    process = eol < end && *eol != '\0';
     if (eol >= end && eof) {
       process = true;
     }
@@ -615,10 +713,14 @@ static void S_parser_feed(cssg_parser *parser, const unsigned char *buffer,
     if (process) {
       if (parser->linebuf.size > 0) {
         cssg_strbuf_put(&parser->linebuf, buffer, chunk_len);
-        S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size);
+        S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size,
+                       false);
         cssg_strbuf_clear(&parser->linebuf);
       } else {
-        S_process_line(parser, buffer, chunk_len);
+        // A line ending in a bare LF that is not the last byte of the
+        // buffer can be processed in place.
+        S_process_line(parser, buffer, chunk_len,
+                       *eol == '\n' && eol + 1 < end);
       }
     } else {
       if (eol < end && *eol == '\0') {
@@ -650,6 +752,21 @@ static void S_parser_feed(cssg_parser *parser, const unsigned char *buffer,
   }
 }
 
+// Lines that need no repair are processed in place, pointing into the
+// buffer passed to the parser, but _scan_at temporarily writes a NUL
+// after the chunk it scans.  So copy such a line into curline the first
+// time a scanner needs it; the rest of the line's processing uses
+// offsets and simply continues on the copy.
+static bufsize_t S_scan_line(cssg_parser *parser, cssg_chunk *input,
+                             bufsize_t (*scanner)(const unsigned char *),
+                             bufsize_t offset) {
+  if (input->data != parser->curline.ptr) {
+    cssg_strbuf_put(&parser->curline, input->data, input->len);
+    input->data = parser->curline.ptr;
+  }
+  return _scan_at(scanner, input, offset);
+}
+
 static void chop_trailing_hashtags(cssg_chunk *ch) {
   bufsize_t n, orig_n;
 
@@ -835,7 +952,8 @@ static bool parse_code_block_prefix(cssg_parser *parser, cssg_chunk *input,
 
     if (parser->indent <= 3 && (peek_at(input, parser->first_nonspace) ==
                                 container->as.code.fence_char)) {
-      matched = scan_close_code_fence(input, parser->first_nonspace);
+      matched = S_scan_line(parser, input, _scan_close_code_fence,
+                            parser->first_nonspace);
     }
 
     if (matched >= container->as.code.fence_length) {
@@ -1004,8 +1122,9 @@ static void open_new_blocks(cssg_parser *parser, cssg_node **container,
       *container = add_child(parser, *container, CSSG_NODE_BLOCK_QUOTE,
                              blockquote_startpos + 1);
 
-    } else if (!indented && (matched = scan_atx_heading_start(
-                                 input, parser->first_nonspace))) {
+    } else if (!indented && peek_at(input, parser->first_nonspace) == '#' &&
+               (matched = S_scan_line(parser, input, _scan_atx_heading_start,
+                                      parser->first_nonspace))) {
       bufsize_t hashpos;
       int level = 0;
       bufsize_t heading_startpos = parser->first_nonspace;
@@ -1027,8 +1146,11 @@ static void open_new_blocks(cssg_parser *parser, cssg_node **container,
       (*container)->as.heading.setext = false;
       (*container)->as.heading.internal_offset = matched;
 
-    } else if (!indented && (matched = scan_open_code_fence(
-                                 input, parser->first_nonspace))) {
+    } else if (!indented &&
+               (peek_at(input, parser->first_nonspace) == '`' ||
+                peek_at(input, parser->first_nonspace) == '~') &&
+               (matched = S_scan_line(parser, input, _scan_open_code_fence,
+                                      parser->first_nonspace))) {
       *container = add_child(parser, *container, CSSG_NODE_CODE_BLOCK,
                              parser->first_nonspace + 1);
       (*container)->as.code.fenced = true;
@@ -1041,20 +1163,23 @@ static void open_new_blocks(cssg_parser *parser, cssg_node **container,
                        parser->first_nonspace + matched - parser->offset,
                        false);
 
-    } else if (!indented && ((matched = scan_html_block_start(
-                                  input, parser->first_nonspace)) ||
-                             (cont_type != CSSG_NODE_PARAGRAPH &&
-                              !maybe_lazy &&
-                              (matched = scan_html_block_start_7(
-                                   input, parser->first_nonspace))))) {
+    } else if (!indented && peek_at(input, parser->first_nonspace) == '<' &&
+               ((matched = S_scan_line(parser, input, _scan_html_block_start,
+                                       parser->first_nonspace)) ||
+                (cont_type != CSSG_NODE_PARAGRAPH && !maybe_lazy &&
+                 (matched = S_scan_line(parser, input,
+                                        _scan_html_block_start_7,
+                                        parser->first_nonspace))))) {
       *container = add_child(parser, *container, CSSG_NODE_HTML_BLOCK,
                              parser->first_nonspace + 1);
       (*container)->as.html_block_type = matched;
       // note, we don't adjust parser->offset because the tag is part of the
       // text
     } else if (!indented && cont_type == CSSG_NODE_PARAGRAPH &&
-               (lev =
-                    scan_setext_heading_line(input, parser->first_nonspace))) {
+               (peek_at(input, parser->first_nonspace) == '=' ||
+                peek_at(input, parser->first_nonspace) == '-') &&
+               (lev = S_scan_line(parser, input, _scan_setext_heading_line,
+                                  parser->first_nonspace))) {
       // finalize paragraph, resolving reference links
       has_content = resolve_reference_link_definitions(parser);
 
@@ -1213,28 +1338,28 @@ static void add_text_to_container(cssg_parser *parser, cssg_node *container,
       switch (container->as.html_block_type) {
       case 1:
         // </script>, </style>, </textarea>, </pre>
-        matches_end_condition =
-            scan_html_block_end_1(input, parser->first_nonspace);
+        matches_end_condition = S_scan_line(
+            parser, input, _scan_html_block_end_1, parser->first_nonspace);
         break;
       case 2:
         // -->
-        matches_end_condition =
-            scan_html_block_end_2(input, parser->first_nonspace);
+        matches_end_condition = S_scan_line(
+            parser, input, _scan_html_block_end_2, parser->first_nonspace);
         break;
       case 3:
         // ?>
-        matches_end_condition =
-            scan_html_block_end_3(input, parser->first_nonspace);
+        matches_end_condition = S_scan_line(
+            parser, input, _scan_html_block_end_3, parser->first_nonspace);
         break;
       case 4:
         // >
-        matches_end_condition =
-            scan_html_block_end_4(input, parser->first_nonspace);
+        matches_end_condition = S_scan_line(
+            parser, input, _scan_html_block_end_4, parser->first_nonspace);
         break;
       case 5:
         // ]]>
-        matches_end_condition =
-            scan_html_block_end_5(input, parser->first_nonspace);
+        matches_end_condition = S_scan_line(
+            parser, input, _scan_html_block_end_5, parser->first_nonspace);
         break;
       default:
         matches_end_condition = 0;
@@ -1268,24 +1393,126 @@ static void add_text_to_container(cssg_parser *parser, cssg_node *container,
   }
 }
 
+// TOML front matter: a first line of "+++", then TOML up to the next
+// "+++" line.  The lines are held back from the block parser until the
+// closing line, and parsed as Markdown after all if there is none.
+
+enum {
+  FRONT_MATTER_NONE, // may start on the first line
+  FRONT_MATTER_OPEN, // lines so far are in front_matter_lines
+  FRONT_MATTER_DONE,
+};
+
+static bool S_is_front_matter_fence(const unsigned char *line,
+                                    bufsize_t len) {
+  bufsize_t i = 3;
+
+  if (len < 3 || memcmp(line, "+++", 3) != 0)
+    return false;
+  while (i < len && S_is_space_or_tab(line[i]))
+    i++;
+  return i == len;
+}
+
+static void S_close_front_matter(cssg_parser *parser) {
+  cssg_strbuf *lines = &parser->front_matter_lines;
+  unsigned char *toml = (unsigned char *)memchr(lines->ptr, '\n',
+                                                (size_t)lines->size);
+
+  // The TOML parser needs a NUL-terminated string, which the buffer is.
+  // The table is allocated like the document, so an arena reset that
+  // drops the document drops it too.
+  if (S_type(parser->root) == CSSG_NODE_DOCUMENT) {
+    toml_table_t **slot = &parser->root->as.document.front_matter;
+    if (*slot)
+      toml_free(*slot);
+    *slot = toml_parse_with_mem((const char *)toml + 1, NULL, 0,
+                                parser->mem->calloc, parser->mem->free);
+    // Decode the values once, so that readers of the front matter do
+    // not parse them on every lookup.
+    if (*slot && toml_decode(*slot) != 0) {
+      toml_free(*slot);
+      *slot = NULL;
+    }
+  }
+  cssg_strbuf_free(lines);
+  parser->front_matter = FRONT_MATTER_DONE;
+}
+
+// Returns true if 'line' belongs to front matter.
+static bool S_front_matter_line(cssg_parser *parser,
+                                const unsigned char *line, bufsize_t len) {
+  if (parser->front_matter == FRONT_MATTER_NONE) {
+    parser->front_matter = FRONT_MATTER_DONE;
+    if (parser->line_number != 0 || !S_is_front_matter_fence(line, len))
+      return false;
+    parser->front_matter = FRONT_MATTER_OPEN;
+    cssg_strbuf_put(&parser->front_matter_lines, line, len);
+    cssg_strbuf_putc(&parser->front_matter_lines, '\n');
+  } else if (S_is_front_matter_fence(line, len)) {
+    S_close_front_matter(parser);
+  } else {
+    cssg_strbuf_put(&parser->front_matter_lines, line, len);
+    cssg_strbuf_putc(&parser->front_matter_lines, '\n');
+  }
+
+  parser->line_number++;
+  parser->last_line_length = len;
+  return true;
+}
+
+// Parses the lines of unterminated front matter as Markdown.
+static void S_replay_front_matter(cssg_parser *parser) {
+  cssg_strbuf lines = parser->front_matter_lines;
+  bufsize_t pos = 0;
+
+  cssg_strbuf_init(parser->mem, &parser->front_matter_lines, 0);
+  parser->front_matter = FRONT_MATTER_DONE;
+  parser->line_number = 0;
+  while (pos < lines.size) {
+    unsigned char *eol = (unsigned char *)memchr(
+        lines.ptr + pos, '\n', (size_t)(lines.size - pos));
+    bufsize_t len = (bufsize_t)(eol - (lines.ptr + pos));
+    S_process_line(parser, lines.ptr + pos, len, false);
+    pos += len + 1;
+  }
+  cssg_strbuf_free(&lines);
+}
+
 /* See http://spec.commonmark.org/0.24/#phase-1-block-structure */
+// Process one line of 'bytes' bytes, not counting its line ending.  If
+// 'borrow' is set, buffer[bytes] is the line's '\n' and the line is used
+// in place instead of being copied into curline.
 static void S_process_line(cssg_parser *parser, const unsigned char *buffer,
-                           bufsize_t bytes) {
+                           bufsize_t bytes, bool borrow) {
   cssg_node *last_matched_container;
   bool all_matched = true;
   cssg_node *container;
   cssg_chunk input;
 
-  if (parser->options & CSSG_OPT_VALIDATE_UTF8)
-    cssg_utf8proc_check(&parser->curline, buffer, bytes);
-  else
-    cssg_strbuf_put(&parser->curline, buffer, bytes);
+  if ((parser->options & CSSG_OPT_FRONT_MATTER) &&
+      parser->front_matter != FRONT_MATTER_DONE &&
+      S_front_matter_line(parser, buffer, bytes))
+    return;
 
-  bytes = parser->curline.size;
+  if (borrow && !(parser->options & CSSG_OPT_VALIDATE_UTF8)) {
+    input.data = buffer;
+    input.len = bytes + 1;
+  } else {
+    if (parser->options & CSSG_OPT_VALIDATE_UTF8)
+      cssg_utf8proc_check(&parser->curline, buffer, bytes);
+    else
+      cssg_strbuf_put(&parser->curline, buffer, bytes);
+
+    bytes = parser->curline.size;
 
-  // ensure line ends with a newline:
-  if (bytes == 0 || !S_is_line_end_char(parser->curline.ptr[bytes - 1]))
-    cssg_strbuf_putc(&parser->curline, '\n');
+    // ensure line ends with a newline:
+    if (bytes == 0 || !S_is_line_end_char(parser->curline.ptr[bytes - 1]))
+      cssg_strbuf_putc(&parser->curline, '\n');
+
+    input.data = parser->curline.ptr;
+    input.len = parser->curline.size;
+  }
 
   parser->offset = 0;
   parser->column = 0;
@@ -1296,9 +1523,7 @@ static void S_process_line(cssg_parser *parser, const unsigned char *buffer,
   parser->blank = false;
   parser->partially_consumed_tab = false;
 
-  input.data = parser->curline.ptr;
-  input.len = parser->curline.size;
-
+  parser->line = input;
   parser->line_number++;
 
   last_matched_container = check_open_blocks(parser, &input, &all_matched);
@@ -1322,17 +1547,20 @@ finished:
     parser->last_line_length -= 1;
 
   cssg_strbuf_clear(&parser->curline);
+  parser->line.data = NULL;
+  parser->line.len = 0;
 }
 
 cssg_node *cssg_parser_finish(cssg_parser *parser) {
   if (parser->linebuf.size) {
-    S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size);
+    S_process_line(parser, parser->linebuf.ptr, parser->linebuf.size, false);
     cssg_strbuf_clear(&parser->linebuf);
   }
 
-  finalize_document(parser);
+  if (parser->front_matter == FRONT_MATTER_OPEN)
+    S_replay_front_matter(parser);
 
-  cssg_consolidate_text_nodes(parser->root);
+  finalize_document(parser);
 
   cssg_strbuf_free(&parser->curline);
 
@@ -1343,3 +1571,272 @@ cssg_node *cssg_parser_finish(cssg_parser *parser) {
 #endif
   return parser->root;
 }
+
+// Incremental reparsing.
+//
+// Once a blank line has been processed with every block closed, the
+// block parser is in the same state as at the start of a document: what
+// follows parses the same no matter what came before.  After an edit,
+// blocks that end at such a point before the edit are kept, parsing
+// restarts there, and it stops at the first such point after the edit
+// where the old tree also has a block boundary.  The old blocks from
+// there on are kept too, moved by the number of lines the edit added.
+// Link reference definitions break this locality, so any text that may
+// hold one is reparsed in full.
+
+// Whether text[i] ends a line: "\n", or "\r" not followed by "\n".
+static inline bool S_is_break(const unsigned char *text, size_t len,
+                              size_t i) {
+  return text[i] == '\n' ||
+         (text[i] == '\r' && (i + 1 == len || text[i + 1] != '\n'));
+}
+
+static int S_count_breaks(const unsigned char *text, size_t len, size_t from,
+                          size_t to) {
+  int breaks = 0;
+
+  for (; from < to; from++)
+    breaks += S_is_break(text, len, from);
+  return breaks;
+}
+
+// Returns the offset of the line after the one starting at 'pos'.
+static size_t S_next_line(const unsigned char *text, size_t len, size_t pos) {
+  while (pos < len && !S_is_break(text, len, pos))
+    pos++;
+  return pos < len ? pos + 1 : len;
+}
+
+static bool S_line_is_blank(const unsigned char *text, size_t len,
+                            size_t pos) {
+  while (pos < len && S_is_space_or_tab(text[pos]))
+    pos++;
+  return pos == len || S_is_line_end_char(text[pos]);
+}
+
+// Whether 'text' may contain a link reference definition, which always
+// has a "]:" after its label.
+static bool S_may_define_refs(const unsigned char *text, size_t len) {
+  const unsigned char *p = text;
+  const unsigned char *end = text + len;
+
+  while ((p = (const unsigned char *)memchr(p, ']', end - p)) != NULL) {
+    if (++p < end && *p == ':')
+      return true;
+  }
+  return false;
+}
+
+// Returns the offset just past the closing line of the front matter
+// that 'text' starts with, or 0 if it has none.  Sets 'opens' if the
+// first line opens front matter.
+static size_t S_front_matter_end(const unsigned char *text, size_t len,
+                                 bool *opens) {
+  size_t pos = len >= 3 && memcmp(text, "\xEF\xBB\xBF", 3) == 0 ? 3 : 0;
+
+  *opens = false;
+  while (pos < len) {
+    size_t next = S_next_line(text, len, pos);
+    size_t end = next;
+    bool fence;
+
+    if (end > pos && text[end - 1] == '\n')
+      end--;
+    if (end > pos && text[end - 1] == '\r')
+      end--;
+    fence = S_is_front_matter_fence(text + pos, (bufsize_t)(end - pos));
+    if (!*opens) {
+      if (!fence)
+        return 0;
+      *opens = true;
+    } else if (fence) {
+      return next;
+    }
+    pos = next;
+  }
+  return 0;
+}
+
+// Top-level blocks that are closed by the blank line following them.
+// Lists and indented code can continue after blank lines.
+static bool S_closed_by_blank_line(cssg_node *node) {
+  switch (S_type(node)) {
+  case CSSG_NODE_LIST:
+    return false;
+  case CSSG_NODE_CODE_BLOCK:
+    return node->as.code.fenced != 0;
+  default:
+    return true;
+  }
+}
+
+// Moves the source positions in 'root' by 'delta' lines.  Some inlines
+// have no position and are left at 0.
+static void S_shift_lines(cssg_node *root, int delta) {
+  cssg_node *node = root;
+
+  while (node) {
+    if (node->start_line)
+      node->start_line += delta;
+    if (node->end_line)
+      node->end_line += delta;
+    if (node->first_child) {
+      node = node->first_child;
+      continue;
+    }
+    while (node != root && !node->next)
+      node = node->parent;
+    node = node == root ? NULL : node->next;
+  }
+}
+
+static void S_add_stats(cssg_document *stats, const cssg_document *more,
+                        const cssg_document *less) {
+  stats->blocks += more->blocks - less->blocks;
+  stats->inlines += more->inlines - less->inlines;
+  stats->text_bytes += more->text_bytes - less->text_bytes;
+  stats->url_bytes += more->url_bytes - less->url_bytes;
+}
+
+int cssg_parser_reparse_range(cssg_node *doc, const char *old_text,
+                              size_t old_len, const char *new_text,
+                              size_t new_len, size_t edit_start,
+                              size_t edit_len, int options) {
+  const unsigned char *old_buf = (const unsigned char *)old_text;
+  const unsigned char *new_buf = (const unsigned char *)new_text;
+  size_t old_end, new_end, from, pos, next;
+  cssg_node *keep = NULL; // last block kept before the edit
+  cssg_node *resume;      // first block kept after the edit, or NULL
+  cssg_node *node, *root;
+  cssg_parser *parser;
+  cssg_document removed;
+  bool local;
+  int line, delta;
+
+  if (doc == NULL || S_type(doc) != CSSG_NODE_DOCUMENT ||
+      edit_start > old_len || edit_len > old_len - edit_start ||
+      new_len < old_len - edit_len)
+    return -1;
+
+  old_end = edit_start + edit_len;
+  new_end = edit_start + (new_len - (old_len - edit_len));
+  from = edit_start > 0 ? edit_start - 1 : 0;
+  delta = S_count_breaks(new_buf, new_len, from, new_end) -
+          S_count_breaks(old_buf, old_len, from, old_end);
+  local = !S_may_define_refs(old_buf, old_len) &&
+          !S_may_define_refs(new_buf, new_len);
+
+  // Front matter is not in the tree, so only edits after it can keep
+  // blocks.
+  if (options & CSSG_OPT_FRONT_MATTER) {
+    bool old_opens, new_opens;
+    size_t front_matter_end =
+        S_front_matter_end(old_buf, old_len, &old_opens);
+
+    S_front_matter_end(new_buf, new_len, &new_opens);
+    if ((old_opens || new_opens) &&
+        (front_matter_end == 0 || edit_start < front_matter_end))
+      local = false;
+  }
+
+  // Keep the last block before the edit that a blank line closes, and
+  // restart parsing at that blank line, which the edit leaves as it is.
+  line = 1;
+  pos = 0;
+  if (local) {
+    int edit_line = S_count_breaks(old_buf, old_len, 0, edit_start) + 1;
+    size_t line_pos = 0;
+    int at_line = 1;
+
+    for (node = doc->first_child;
+         node && node->end_line + 1 < edit_line; node = node->next) {
+      while (at_line <= node->end_line) {
+        line_pos = S_next_line(old_buf, old_len, line_pos);
+        at_line++;
+      }
+      // A setext heading's end_line can be the line after its underline,
+      // so also check that the blank line comes before the next block.
+      if (S_closed_by_blank_line(node) &&
+          (node->next == NULL || at_line < node->next->start_line) &&
+          S_line_is_blank(old_buf, old_len, line_pos)) {
+        keep = node;
+        line = at_line;
+        pos = line_pos;
+      }
+    }
+  }
+
+  parser = cssg_parser_new_with_mem(options, doc->mem);
+  root = parser->root;
+  parser->line_number = line - 1;
+  resume = keep ? keep->next : doc->first_child;
+
+  // Feed the edited text up to the end of each blank line after the edit,
+  // stopping where both parses are back at the start of a document.
+  while (pos < new_len) {
+    next = local ? S_next_line(new_buf, new_len, pos) : new_len;
+    while (next < new_len &&
+           (next <= new_end || !S_line_is_blank(new_buf, new_len, next)))
+      next = S_next_line(new_buf, new_len, next);
+    if (next < new_len)
+      next = S_next_line(new_buf, new_len, next);
+    S_parser_feed(parser, new_buf + pos, next - pos, next == new_len);
+    pos = next;
+
+    if (pos < new_len && parser->current == root) {
+      int old_line = parser->line_number - delta;
+
+      while (resume && resume->start_line <= old_line)
+        resume = resume->next;
+      node = resume ? resume->prev : doc->last_child;
+      if (resume && (node == NULL || node->end_line < old_line))
+        break;
+    }
+  }
+  if (pos >= new_len)
+    resume = NULL;
+
+  cssg_parser_finish(parser);
+
+  // Parsing from the first line has read the front matter again.
+  if (keep == NULL) {
+    if (doc->as.document.front_matter)
+      toml_free(doc->as.document.front_matter);
+    doc->as.document.front_matter = root->as.document.front_matter;
+    root->as.document.front_matter = NULL;
+  }
+
+  // Replace the old blocks between 'keep' and 'resume' with the new ones.
+  memset(&removed, 0, sizeof(removed));
+  node = keep ? keep->next : doc->first_child;
+  while (node != resume) {
+    cssg_node *next_node = node->next;
+    S_count_node(&removed, node);
+    S_count_subtree(&removed, node);
+    cssg_node_free(node);
+    node = next_node;
+  }
+  S_add_stats(&doc->as.document, &root->as.document, &removed);
+
+  while ((node = root->first_child) != NULL) {
+    if (resume)
+      cssg_node_insert_before(resume, node);
+    else
+      cssg_node_append_child(doc, node);
+  }
+
+  if (resume) {
+    if (delta != 0) {
+      for (node = resume; node; node = node->next)
+        S_shift_lines(node, delta);
+    }
+    doc->end_line += delta;
+  } else {
+    doc->end_line = root->end_line;
+    doc->end_column = root->end_column;
+  }
+
+  cssg_node_free(root);
+  cssg_parser_free(parser);
+  return keep != NULL || resume != NULL;
+}
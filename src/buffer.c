@@ -58,6 +58,20 @@ void cssg_strbuf_grow(cssg_strbuf *buf, bufsize_t target_size) {
   buf->asize = new_size;
 }
 
+void cssg_strbuf_reserve(cssg_strbuf *buf, bufsize_t size) {
+  bufsize_t new_size;
+
+  if (size <= 0 || size < buf->asize || size > (bufsize_t)(INT32_MAX / 2))
+    return;
+
+  new_size = (size + 1 + 7) & ~7;
+  buf->ptr = (unsigned char *)buf->mem->realloc(buf->asize ? buf->ptr : NULL,
+                                                new_size);
+  if (!buf->asize)
+    buf->ptr[0] = '\0';
+  buf->asize = new_size;
+}
+
 void cssg_strbuf_free(cssg_strbuf *buf) {
   if (!buf)
     return;
@@ -40,6 +40,12 @@ void cssg_strbuf_init(cssg_mem *mem, cssg_strbuf *buf,
  */
 void cssg_strbuf_grow(cssg_strbuf *buf, bufsize_t target_size);
 
+/**
+ * Make room for at least `size` bytes without the usual 50% slack, for
+ * callers that know how large the buffer will get.
+ */
+void cssg_strbuf_reserve(cssg_strbuf *buf, bufsize_t size);
+
 void cssg_strbuf_free(cssg_strbuf *buf);
 
 unsigned char *cssg_strbuf_detach(cssg_strbuf *buf);
@@ -0,0 +1,298 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cssg.h"
+#include "node.h"
+#include "cache.h"
+
+// Parse-once, render-many caches of documents and of rendered blocks.
+//
+// Both are a chained hash table keyed by a 64-bit hash, plus a list in
+// order of use so the least recently used entries can be dropped when a
+// cache goes over its budget.  Document entries keep their source and
+// fragment entries keep the key of their block and render state, so a
+// hash collision can never return the wrong tree or HTML.
+
+#define CACHE_MIN_BUCKETS 16
+
+// Options that change the tree.  Source positions are always recorded,
+// so documents rendered with and without CSSG_OPT_SOURCEPOS share an
+// entry.
+#define CACHE_PARSE_OPTIONS                                                    \
+  (CSSG_OPT_VALIDATE_UTF8 | CSSG_OPT_SMART | CSSG_OPT_FRONT_MATTER)
+
+typedef struct cache_entry {
+  struct cache_entry *chain; // next entry in the same bucket
+  struct cache_entry *newer;
+  struct cache_entry *older;
+  uint64_t hash;
+  int options;
+  size_t cost;
+  unsigned char *data; // document source, or fragment key and HTML
+  size_t len;
+  size_t key_len;      // bytes of 'data' that are a fragment key
+  cssg_node *doc;      // NULL in a fragment cache
+} cache_entry;
+
+typedef struct {
+  cssg_mem *mem;
+  cache_entry **buckets;
+  size_t nbuckets;
+  size_t count;
+  size_t used;
+  size_t budget;
+  cache_entry *newest;
+  cache_entry *oldest;
+} lru_cache;
+
+struct cssg_doc_cache {
+  lru_cache lru;
+};
+
+struct cssg_fragment_cache {
+  lru_cache lru;
+};
+
+static void lru_init(lru_cache *cache, size_t budget) {
+  cache->mem = cssg_get_default_mem_allocator();
+  cache->budget = budget;
+  cache->nbuckets = CACHE_MIN_BUCKETS;
+  cache->buckets = (cache_entry **)cache->mem->calloc(cache->nbuckets,
+                                                      sizeof(cache_entry *));
+}
+
+static void unlink_lru(lru_cache *cache, cache_entry *entry) {
+  if (entry->newer)
+    entry->newer->older = entry->older;
+  else
+    cache->newest = entry->older;
+  if (entry->older)
+    entry->older->newer = entry->newer;
+  else
+    cache->oldest = entry->newer;
+  entry->newer = entry->older = NULL;
+}
+
+static void push_newest(lru_cache *cache, cache_entry *entry) {
+  entry->older = cache->newest;
+  entry->newer = NULL;
+  if (cache->newest)
+    cache->newest->newer = entry;
+  else
+    cache->oldest = entry;
+  cache->newest = entry;
+}
+
+static void remove_entry(lru_cache *cache, cache_entry *entry) {
+  cache_entry **link = &cache->buckets[entry->hash % cache->nbuckets];
+
+  while (*link != entry)
+    link = &(*link)->chain;
+  *link = entry->chain;
+  unlink_lru(cache, entry);
+
+  cache->count--;
+  cache->used -= entry->cost;
+  if (entry->doc)
+    cssg_node_free(entry->doc);
+  cache->mem->free(entry->data);
+  cache->mem->free(entry);
+}
+
+static void lru_release(lru_cache *cache) {
+  while (cache->oldest)
+    remove_entry(cache, cache->oldest);
+  cache->mem->free(cache->buckets);
+}
+
+static void grow_buckets(lru_cache *cache) {
+  size_t nbuckets = cache->nbuckets * 2;
+  cache_entry **buckets =
+      (cache_entry **)cache->mem->calloc(nbuckets, sizeof(cache_entry *));
+  size_t i;
+
+  for (i = 0; i < cache->nbuckets; i++) {
+    cache_entry *entry = cache->buckets[i];
+    while (entry) {
+      cache_entry *next = entry->chain;
+      cache_entry **bucket = &buckets[entry->hash % nbuckets];
+      entry->chain = *bucket;
+      *bucket = entry;
+      entry = next;
+    }
+  }
+  cache->mem->free(cache->buckets);
+  cache->buckets = buckets;
+  cache->nbuckets = nbuckets;
+}
+
+// Returns the first entry from 'entry' on with 'hash'.  Callers comparing
+// more than the hash continue the search from 'entry->chain'.
+static cache_entry *lru_find(cache_entry *entry, uint64_t hash) {
+  for (; entry; entry = entry->chain) {
+    if (entry->hash == hash)
+      return entry;
+  }
+  return NULL;
+}
+
+static void lru_touch(lru_cache *cache, cache_entry *entry) {
+  unlink_lru(cache, entry);
+  push_newest(cache, entry);
+}
+
+// Adds a new, most recently used entry holding a copy of 'key' followed
+// by a copy of 'data'.
+static cache_entry *lru_insert(lru_cache *cache, uint64_t hash,
+                              const unsigned char *key, size_t key_len,
+                              const unsigned char *data, size_t len) {
+  cache_entry *entry =
+      (cache_entry *)cache->mem->calloc(1, sizeof(cache_entry));
+  cache_entry **bucket;
+
+  entry->hash = hash;
+  entry->key_len = key_len;
+  entry->len = key_len + len;
+  entry->data = (unsigned char *)cache->mem->realloc(
+      NULL, entry->len ? entry->len : 1);
+  if (key_len)
+    memcpy(entry->data, key, key_len);
+  if (len)
+    memcpy(entry->data + key_len, data, len);
+  entry->cost = sizeof(cache_entry) + entry->len;
+
+  if (cache->count + 1 > cache->nbuckets)
+    grow_buckets(cache);
+  bucket = &cache->buckets[hash % cache->nbuckets];
+  entry->chain = *bucket;
+  *bucket = entry;
+  push_newest(cache, entry);
+  cache->count++;
+  cache->used += entry->cost;
+  return entry;
+}
+
+// Drops the least recently used entries until the cache is within its
+// budget.  The newest entry is always kept, even if it alone is over.
+static void lru_trim(lru_cache *cache) {
+  while (cache->used > cache->budget && cache->oldest != cache->newest)
+    remove_entry(cache, cache->oldest);
+}
+
+// FNV-1a, with the options folded in last.
+static uint64_t source_hash(const char *buffer, size_t len, int options) {
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)buffer[i];
+    h *= 1099511628211ULL;
+  }
+  h ^= (uint64_t)(unsigned)options;
+  h *= 1099511628211ULL;
+  return h;
+}
+
+// Approximate memory held by the nodes of a document and their literal
+// content.
+static size_t tree_cost(cssg_node *doc) {
+  const cssg_document *stats = &doc->as.document;
+
+  return ((size_t)stats->blocks + (size_t)stats->inlines + 1) *
+             (sizeof(cssg_node) + 2 * sizeof(void *)) +
+         (size_t)stats->text_bytes + (size_t)stats->url_bytes;
+}
+
+cssg_doc_cache *cssg_doc_cache_new(size_t budget) {
+  cssg_mem *mem = cssg_get_default_mem_allocator();
+  cssg_doc_cache *cache =
+      (cssg_doc_cache *)mem->calloc(1, sizeof(cssg_doc_cache));
+
+  lru_init(&cache->lru, budget);
+  return cache;
+}
+
+void cssg_doc_cache_free(cssg_doc_cache *cache) {
+  if (cache == NULL)
+    return;
+  lru_release(&cache->lru);
+  cache->lru.mem->free(cache);
+}
+
+cssg_node *cssg_doc_cache_get(cssg_doc_cache *cache, const char *buffer,
+                              size_t len, int options) {
+  lru_cache *lru = &cache->lru;
+  int key_options = options & CACHE_PARSE_OPTIONS;
+  uint64_t hash = source_hash(buffer, len, key_options);
+  cache_entry *entry = lru->buckets[hash % lru->nbuckets];
+  size_t cost;
+
+  while ((entry = lru_find(entry, hash)) != NULL) {
+    if (entry->options == key_options && entry->len == len &&
+        memcmp(entry->data, buffer, len) == 0) {
+      lru_touch(lru, entry);
+      return entry->doc;
+    }
+    entry = entry->chain;
+  }
+
+  entry = lru_insert(lru, hash, NULL, 0, (const unsigned char *)buffer, len);
+  entry->options = key_options;
+  entry->doc =
+      cssg_parse_document(buffer, len, key_options | CSSG_OPT_SOURCEPOS);
+  cost = tree_cost(entry->doc);
+  entry->cost += cost;
+  lru->used += cost;
+  lru_trim(lru);
+
+  return entry->doc;
+}
+
+size_t cssg_doc_cache_size(cssg_doc_cache *cache) { return cache->lru.used; }
+
+cssg_fragment_cache *cssg_fragment_cache_new(size_t budget) {
+  cssg_mem *mem = cssg_get_default_mem_allocator();
+  cssg_fragment_cache *cache =
+      (cssg_fragment_cache *)mem->calloc(1, sizeof(cssg_fragment_cache));
+
+  lru_init(&cache->lru, budget);
+  return cache;
+}
+
+void cssg_fragment_cache_free(cssg_fragment_cache *cache) {
+  if (cache == NULL)
+    return;
+  lru_release(&cache->lru);
+  cache->lru.mem->free(cache);
+}
+
+size_t cssg_fragment_cache_size(cssg_fragment_cache *cache) {
+  return cache->lru.used;
+}
+
+bool cssg_fragment_cache_get(cssg_fragment_cache *cache, uint64_t hash,
+                             const unsigned char *key, size_t key_len,
+                             const unsigned char **data, size_t *len) {
+  lru_cache *lru = &cache->lru;
+  cache_entry *entry = lru->buckets[hash % lru->nbuckets];
+
+  while ((entry = lru_find(entry, hash)) != NULL) {
+    if (entry->key_len == key_len &&
+        memcmp(entry->data, key, key_len) == 0) {
+      lru_touch(lru, entry);
+      *data = entry->data + key_len;
+      *len = entry->len - key_len;
+      return true;
+    }
+    entry = entry->chain;
+  }
+  return false;
+}
+
+void cssg_fragment_cache_put(cssg_fragment_cache *cache, uint64_t hash,
+                             const unsigned char *key, size_t key_len,
+                             const unsigned char *data, size_t len) {
+  lru_insert(&cache->lru, hash, key, key_len, data, len);
+  lru_trim(&cache->lru);
+}
@@ -0,0 +1,35 @@
+#ifndef CSSG_CACHE_H
+#define CSSG_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cssg.h"
+
+/**
+ * Look up the fragment stored under the 'key_len' bytes at 'key', whose
+ * hash is 'hash'.  On a hit, sets 'data' and 'len' to the cached bytes,
+ * which stay valid until the next call that adds to 'cache', and returns
+ * true.
+ */
+bool cssg_fragment_cache_get(cssg_fragment_cache *cache, uint64_t hash,
+                             const unsigned char *key, size_t key_len,
+                             const unsigned char **data, size_t *len);
+
+/**
+ * Store a copy of 'len' bytes at 'data' under a copy of 'key'.
+ */
+void cssg_fragment_cache_put(cssg_fragment_cache *cache, uint64_t hash,
+                             const unsigned char *key, size_t key_len,
+                             const unsigned char *data, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -86,6 +86,10 @@ typedef enum {
 typedef struct cssg_node cssg_node;
 typedef struct cssg_parser cssg_parser;
 typedef struct cssg_iter cssg_iter;
+typedef struct cssg_reference_map cssg_reference_map;
+typedef struct cssg_doc_cache cssg_doc_cache;
+typedef struct cssg_fragment_cache cssg_fragment_cache;
+struct toml_table_t;
 
 /**
  * ## Custom memory allocator support
@@ -104,6 +108,26 @@ typedef struct cssg_mem {
  */
 CSSG_EXPORT cssg_mem *cssg_get_default_mem_allocator(void);
 
+/** Returns a pointer to an arena allocator.  Memory is handed out from
+ * large chunks and never freed individually; instead, everything
+ * allocated from the arena is released at once by 'cssg_arena_reset'.
+ * Pass it to 'cssg_parser_new_with_mem' to parse a document without
+ * per-node malloc traffic.  The arena is per thread: a document must be
+ * parsed, rendered and reset on the same thread.
+ */
+CSSG_EXPORT cssg_mem *cssg_get_arena_mem_allocator(void);
+
+/** Releases everything allocated from the calling thread's arena,
+ * invalidating every node and string obtained from it.  The largest
+ * chunk is kept for reuse by the next document.
+ */
+CSSG_EXPORT void cssg_arena_reset(void);
+
+/** Like 'cssg_arena_reset', but also returns the retained chunk to the
+ * system.  Call it before a thread that used the arena exits.
+ */
+CSSG_EXPORT void cssg_arena_release(void);
+
 /**
  * ## Creating and Destroying Nodes
  */
@@ -401,6 +425,14 @@ CSSG_EXPORT int cssg_node_get_end_line(cssg_node *node);
  */
 CSSG_EXPORT int cssg_node_get_end_column(cssg_node *node);
 
+/** Returns the table parsed from the TOML front matter of document
+ * 'node' (see `CSSG_OPT_FRONT_MATTER`), or NULL if it has none or the
+ * front matter is not valid TOML.  The table belongs to the document:
+ * it is allocated with the document's allocator and is freed with it.
+ * Read it with the functions in toml.h.
+ */
+CSSG_EXPORT struct toml_table_t *cssg_node_get_front_matter(cssg_node *node);
+
 /**
  * ## Tree Manipulation
  */
@@ -526,6 +558,25 @@ cssg_node *cssg_parser_finish(cssg_parser *parser);
 CSSG_EXPORT
 cssg_node *cssg_parse_document(const char *buffer, size_t len, int options);
 
+/** Update 'doc', parsed from 'old_text' of length 'old_len' with
+ * 'options', to match 'new_text' of length 'new_len', which is
+ * 'old_text' with the 'edit_len' bytes at 'edit_start' replaced.
+ * Top-level blocks away from the edit are kept, and only the text
+ * between the nearest blank lines around the edit at which no block
+ * is open is parsed again; the kept blocks after the edit have their
+ * line numbers moved.  If either text may define link references, the
+ * whole of 'new_text' is parsed.  References shared with
+ * 'cssg_parser_set_shared_references' are not used.  Returns 1 if
+ * blocks were kept, 0 if the whole document was parsed again, or -1 if
+ * the arguments do not describe an edit, in which case 'doc' is not
+ * changed.
+ */
+CSSG_EXPORT
+int cssg_parser_reparse_range(cssg_node *doc, const char *old_text,
+                              size_t old_len, const char *new_text,
+                              size_t new_len, size_t edit_start,
+                              size_t edit_len, int options);
+
 /** Parse a CommonMark document in file 'f', returning a pointer to
  * a tree of nodes.  The memory allocated for the node tree should be
  * released using 'cssg_node_free' when it is no longer needed.
@@ -533,6 +584,152 @@ cssg_node *cssg_parse_document(const char *buffer, size_t len, int options);
 CSSG_EXPORT
 cssg_node *cssg_parse_file(FILE *f, int options);
 
+/** Parse the CommonMark document in the file at 'path', returning a
+ * pointer to a tree of nodes, or NULL with 'errno' set if the file
+ * cannot be read.  Regular files are memory-mapped and parsed in place;
+ * pipes and other unmappable files are read into memory first.  The
+ * node tree should be released using 'cssg_node_free' when it is no
+ * longer needed.
+ */
+CSSG_EXPORT
+cssg_node *cssg_parse_path(const char *path, int options);
+
+/** Like 'cssg_parse_path', but allocates the node tree with 'mem'.
+ */
+CSSG_EXPORT
+cssg_node *cssg_parse_path_with_mem(const char *path, int options,
+                                    cssg_mem *mem);
+
+/** The contents of a file opened with 'cssg_input_open'.  'data' and
+ * 'len' are read-only; 'mapped' is private to the implementation.
+ */
+typedef struct cssg_input {
+  const char *data;
+  size_t len;
+  int mapped;
+} cssg_input;
+
+/** Makes the contents of the file at 'path' available in 'input',
+ * memory-mapping regular files and reading anything else.  Returns 0
+ * on success, or -1 with 'errno' set.  The data is not NUL-terminated
+ * and must not be modified; truncating a mapped file while it is open
+ * is undefined behavior.  Release it with 'cssg_input_close'.
+ */
+CSSG_EXPORT
+int cssg_input_open(cssg_input *input, const char *path);
+
+/** Releases the contents of a file opened with 'cssg_input_open'.
+ */
+CSSG_EXPORT
+void cssg_input_close(cssg_input *input);
+
+/** Loads the link reference definitions in the file at 'path' into a
+ * new reference map, or returns NULL with 'errno' set on failure.
+ * Files ending in `.toml` hold one `label = "url"` or
+ * `label = { url = "...", title = "..." }` entry per definition;
+ * anything else is parsed as Markdown with 'options' and only its
+ * definitions are kept.  Free the map with 'cssg_reference_map_free'.
+ */
+CSSG_EXPORT
+cssg_reference_map *cssg_reference_map_load(const char *path, int options);
+
+/** Frees a reference map returned by 'cssg_reference_map_load'.
+ */
+CSSG_EXPORT
+void cssg_reference_map_free(cssg_reference_map *map);
+
+/** Makes 'parser' fall back to 'shared' for link labels its document
+ * does not define itself.  The map is only read, so one map can serve
+ * many parsers, including on different threads; it must outlive them.
+ */
+CSSG_EXPORT
+void cssg_parser_set_shared_references(cssg_parser *parser,
+                                       const cssg_reference_map *shared);
+
+/**
+ * ## Document cache
+ *
+ * For callers that render the same sources many times, possibly with
+ * different rendering options:
+ *
+ *     cssg_doc_cache *cache = cssg_doc_cache_new(64 * 1024 * 1024);
+ *     document = cssg_doc_cache_get(cache, buffer, len, options);
+ *     html = cssg_render_html(document, options);
+ *     ...
+ *     cssg_doc_cache_free(cache);
+ */
+
+/** Creates a cache of parsed documents that keeps about 'budget' bytes
+ * of sources and node trees, dropping the least recently used documents
+ * beyond that.
+ */
+CSSG_EXPORT
+cssg_doc_cache *cssg_doc_cache_new(size_t budget);
+
+/** Frees 'cache' and every document in it.
+ */
+CSSG_EXPORT
+void cssg_doc_cache_free(cssg_doc_cache *cache);
+
+/** Returns the document parsed from 'buffer' of length 'len', parsing
+ * it only if the cache holds no tree for the same source and parse
+ * options.  Source positions are always recorded, so the tree can be
+ * rendered with or without `CSSG_OPT_SOURCEPOS`.  The tree belongs to
+ * the cache: it must not be modified or freed, and it stays valid only
+ * until the next call to 'cssg_doc_cache_get' or 'cssg_doc_cache_free'
+ * on 'cache'.  A cache is not thread-safe.
+ */
+CSSG_EXPORT
+cssg_node *cssg_doc_cache_get(cssg_doc_cache *cache, const char *buffer,
+                              size_t len, int options);
+
+/** Returns the approximate number of bytes held by 'cache'.
+ */
+CSSG_EXPORT
+size_t cssg_doc_cache_size(cssg_doc_cache *cache);
+
+/**
+ * ## Fragment cache
+ *
+ * For callers that render successive versions of a document, such as
+ * an editor preview.  The HTML of each top-level block is kept under a
+ * hash of the block's parsed content, so after an edit only the blocks
+ * that changed are rendered again:
+ *
+ *     cssg_fragment_cache *cache = cssg_fragment_cache_new(4 * 1024 * 1024);
+ *     html = cssg_render_html_cached(document, options, cache);
+ *     ...
+ *     cssg_fragment_cache_free(cache);
+ */
+
+/** Creates a cache of rendered blocks that keeps about 'budget' bytes,
+ * dropping the least recently used blocks beyond that.
+ */
+CSSG_EXPORT
+cssg_fragment_cache *cssg_fragment_cache_new(size_t budget);
+
+/** Frees 'cache'.
+ */
+CSSG_EXPORT
+void cssg_fragment_cache_free(cssg_fragment_cache *cache);
+
+/** Returns the approximate number of bytes held by 'cache'.
+ */
+CSSG_EXPORT
+size_t cssg_fragment_cache_size(cssg_fragment_cache *cache);
+
+/** Render a parsed document like 'cssg_render_html', reusing the HTML
+ * of top-level blocks found in 'cache' and adding the others to it.
+ * The output is the same as that of 'cssg_render_html'.  Blocks added
+ * through the node API, and trees that are not documents, are always
+ * rendered.  If 'cache' is NULL this is 'cssg_render_html'.  A cache
+ * may be shared by several documents, since HTML is only reused for a
+ * block equal to the one it was rendered from, but is not thread-safe.
+ */
+CSSG_EXPORT
+char *cssg_render_html_cached(cssg_node *root, int options,
+                              cssg_fragment_cache *cache);
+
 /**
  * ## Rendering
  */
@@ -550,6 +747,27 @@ char *cssg_render_xml(cssg_node *root, int options);
 CSSG_EXPORT
 char *cssg_render_html(cssg_node *root, int options);
 
+/** Receives a piece of rendered output.  Returns 0 to continue, or a
+ * nonzero value to stop rendering, which is then returned to the caller.
+ */
+typedef int (*cssg_write_cb)(const char *data, size_t len, void *userdata);
+
+/** Render a 'node' tree as HTML like 'cssg_render_html', passing the
+ * output to 'write' in pieces of about 16 KB instead of returning one
+ * string, so memory use does not grow with the size of the page.
+ * Returns 0, or the first nonzero value returned by 'write'.
+ */
+CSSG_EXPORT
+int cssg_render_html_to(cssg_node *root, int options, cssg_write_cb write,
+                        void *userdata);
+
+/** Return a hash of the page template that 'cssg_render_html' wraps
+ * around every document (including the library version), so that
+ * callers caching rendered pages can tell when they went stale.
+ */
+CSSG_EXPORT
+unsigned long long cssg_html_template_hash(void);
+
 /** Render a 'node' tree as a groff man page, without the header.
  * It is the caller's responsibility to free the returned buffer.
  */
@@ -617,6 +835,12 @@ char *cssg_render_commonmark(cssg_node *root, int options, int width);
  */
 #define CSSG_OPT_SMART (1 << 10)
 
+/** Parse a leading block of TOML between two `+++` lines as front
+ * matter instead of Markdown; see 'cssg_node_get_front_matter'.  If
+ * the closing `+++` is missing, the lines are parsed as Markdown.
+ */
+#define CSSG_OPT_FRONT_MATTER (1 << 11)
+
 /**
  * ## Version information
  */
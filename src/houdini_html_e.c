@@ -3,6 +3,7 @@
 #include <string.h>
 
 #include "houdini.h"
+#include "simd.h"
 
 #if !defined(__has_builtin)
 # define __has_builtin(b) 0
@@ -43,14 +44,30 @@ static const char HTML_ESCAPE_TABLE[] = {
 static const char *HTML_ESCAPES[] = {"",      "&quot;", "&amp;", "&#39;",
                                      "&#47;", "&lt;",   "&gt;"};
 
+// The bytes that stop the scan for clean spans: `'` and `/` are only
+// escaped in secure mode.
+/* "\"&<>", generated by tools/make_byteset.py */
+static const cssg_byteset HTML_ESCAPE_SET = {
+    {0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x00},
+    {0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+/* "\"&'/<>", generated by tools/make_byteset.py */
+static const cssg_byteset HTML_ESCAPE_SECURE_SET = {
+    {0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x01,
+     0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x02, 0x01},
+    {0x00, 0x00, 0x01, 0x02, 0x00, 0x00, 0x00, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
 int houdini_escape_html(cssg_strbuf *ob, const uint8_t *src, bufsize_t size,
                          int secure) {
-  bufsize_t i = 0, org, esc = 0;
+  const cssg_byteset *set = secure ? &HTML_ESCAPE_SECURE_SET : &HTML_ESCAPE_SET;
+  bufsize_t i = 0, org;
 
   while (i < size) {
     org = i;
-    while (i < size && (esc = HTML_ESCAPE_TABLE[src[i]]) == 0)
-      i++;
+    i += cssg_byteset_find(set, src + i, size - i);
 
     if (i > org)
       cssg_strbuf_put(ob, src + org, i - org);
@@ -59,12 +76,7 @@ int houdini_escape_html(cssg_strbuf *ob, const uint8_t *src, bufsize_t size,
     if (unlikely(i >= size))
       break;
 
-    /* The forward slash is only escaped in secure mode */
-    if ((src[i] == '/' || src[i] == '\'') && !secure) {
-      cssg_strbuf_putc(ob, src[i]);
-    } else {
-      cssg_strbuf_puts(ob, HTML_ESCAPES[esc]);
-    }
+    cssg_strbuf_puts(ob, HTML_ESCAPES[(int)HTML_ESCAPE_TABLE[src[i]]]);
 
     i++;
   }
@@ -18,41 +18,34 @@
 #define likely(e) __builtin_expect((e), 1)
 #define unlikely(e) __builtin_expect((e), 0)
 
-/* Binary tree lookup code for entities added by JGM */
-
-static const unsigned char *S_lookup(int i, int low, int hi,
-                                     const unsigned char *s, int len,
-                                     bufsize_t *size_out) {
-  int j;
-  uint32_t value = cssg_entities[i];
-  const unsigned char *ent_name = cssg_entity_text + ENT_TEXT_IDX(value);
-  int ent_len = ENT_NAME_SIZE(value);
-  int min_len = len < ent_len ? len : ent_len;
-  int cmp =
-      strncmp((const char *)s, (const char *)ent_name, min_len);
-  if (cmp == 0)
-    cmp = len - ent_len;
-  if (cmp == 0) {
-    *size_out = ENT_REPL_SIZE(value);
-    return ent_name + ent_len;
-  } else if (cmp <= 0 && i > low) {
-    j = i - ((i - low) / 2);
-    if (j == i)
-      j -= 1;
-    return S_lookup(j, low, i - 1, s, len, size_out);
-  } else if (cmp > 0 && i < hi) {
-    j = i + ((hi - i) / 2);
-    if (j == i)
-      j += 1;
-    return S_lookup(j, i + 1, hi, s, len, size_out);
-  } else {
-    return NULL;
+/* Entity names are found with a minimal perfect hash generated by
+ * tools/make_entities_inc.py: the name's bucket gives a displacement, which
+ * seeds a second hash naming the only slot that can hold it.  One string
+ * compare then confirms the match. */
+
+static uint32_t S_entity_hash(const unsigned char *s, int len, uint32_t seed) {
+  uint32_t h = 2166136261u ^ seed;
+  int i;
+
+  for (i = 0; i < len; i++) {
+    h ^= s[i];
+    h *= 16777619u;
   }
+  return h;
 }
 
 static const unsigned char *S_lookup_entity(const unsigned char *s, int len,
                                             bufsize_t *size_out) {
-  return S_lookup(ENT_TABLE_SIZE / 2, 0, ENT_TABLE_SIZE - 1, s, len, size_out);
+  uint32_t disp = cssg_entity_disp[S_entity_hash(s, len, 0) % ENT_BUCKETS];
+  uint32_t value =
+      cssg_entities[S_entity_hash(s, len, disp) % ENT_TABLE_SIZE];
+  const unsigned char *ent_name = cssg_entity_text + ENT_TEXT_IDX(value);
+
+  if ((int)ENT_NAME_SIZE(value) != len || memcmp(s, ent_name, len) != 0)
+    return NULL;
+
+  *size_out = ENT_REPL_SIZE(value);
+  return ent_name + len;
 }
 
 bufsize_t houdini_unescape_ent(cssg_strbuf *ob, const uint8_t *src,
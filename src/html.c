@@ -1,5 +1,6 @@
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -8,12 +9,21 @@
 #include "cssg.h"
 #include "node.h"
 #include "buffer.h"
+#include "iterator.h"
+#include "cache.h"
 #include "houdini.h"
 #include "scanners.h"
 
 #include "html.h"
 
 #define BUFFER_SIZE 100
+#define IMAGE_PREFIX "publish/static/images/"
+
+// cssg_render_html_to() hands output to its callback whenever this much
+// has accumulated, and escapes long literals in slices of RENDER_SLICE
+// source bytes so no single node can grow the buffer much beyond it.
+#define RENDER_FLUSH_SIZE (16 * 1024)
+#define RENDER_SLICE 4096
 
 // Functions to convert cssg_nodes to HTML strings.
 
@@ -30,8 +40,43 @@ static inline void cr(cssg_strbuf *html) {
 struct render_state {
   cssg_strbuf *html;
   cssg_node *plain;
+  cssg_write_cb write; // NULL when rendering to a string
+  void *userdata;
+  int error;
 };
 
+// Passes all but the last byte of the buffer to the write callback.  The
+// last byte is kept so that cr() still sees the preceding character.
+static void S_flush(struct render_state *state, bufsize_t threshold) {
+  cssg_strbuf *html = state->html;
+
+  if (state->write == NULL || html->size <= threshold)
+    return;
+  if (state->error == 0)
+    state->error = state->write((const char *)html->ptr,
+                                (size_t)(html->size - 1), state->userdata);
+  html->ptr[0] = html->ptr[html->size - 1];
+  html->ptr[1] = '\0';
+  html->size = 1;
+}
+
+static void S_put_literal(struct render_state *state,
+                          const unsigned char *data, bufsize_t len,
+                          bool escape) {
+  bufsize_t slice = state->write ? RENDER_SLICE : len;
+
+  while (len > 0) {
+    bufsize_t n = len < slice ? len : slice;
+    if (escape)
+      escape_html(state->html, data, n);
+    else
+      cssg_strbuf_put(state->html, data, n);
+    S_flush(state, RENDER_FLUSH_SIZE);
+    data += n;
+    len -= n;
+  }
+}
+
 static void S_render_sourcepos(cssg_node *node, cssg_strbuf *html,
                                int options) {
   char buffer[BUFFER_SIZE];
@@ -64,7 +109,7 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
     case CSSG_NODE_TEXT:
     case CSSG_NODE_CODE:
     case CSSG_NODE_HTML_INLINE:
-      escape_html(html, node->data, node->len);
+      S_put_literal(state, node->data, node->len, true);
       break;
 
     case CSSG_NODE_LINEBREAK:
@@ -185,14 +230,14 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
       cssg_strbuf_puts(html, "\">");
     }
 
-    escape_html(html, node->data, node->len);
+    S_put_literal(state, node->data, node->len, true);
     cssg_strbuf_puts(html, "</code></pre>\n");
     break;
 
   case CSSG_NODE_HTML_BLOCK:
     cr(html);
     // support <TABLE> as raw HTML; markdown is just HTML shorthand anyway
-    cssg_strbuf_put(html, node->data, node->len);
+    S_put_literal(state, node->data, node->len, false);
     cr(html);
     break;
 
@@ -235,7 +280,7 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
     break;
 
   case CSSG_NODE_TEXT:
-    escape_html(html, node->data, node->len);
+    S_put_literal(state, node->data, node->len, true);
     break;
 
   case CSSG_NODE_LINEBREAK:
@@ -254,12 +299,12 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
 
   case CSSG_NODE_CODE:
     cssg_strbuf_puts(html, "<code>");
-    escape_html(html, node->data, node->len);
+    S_put_literal(state, node->data, node->len, true);
     cssg_strbuf_puts(html, "</code>");
     break;
 
   case CSSG_NODE_HTML_INLINE:
-    cssg_strbuf_put(html, node->data, node->len);
+    S_put_literal(state, node->data, node->len, false);
     break;
 
   case CSSG_NODE_CUSTOM_INLINE: {
@@ -308,7 +353,7 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
 
   case CSSG_NODE_IMAGE:
     if (entering) {
-      cssg_strbuf_puts(html, "<img src=\"publish/static/images/");
+      cssg_strbuf_puts(html, "<img src=\"" IMAGE_PREFIX);
       if (node->as.link.url) {
         houdini_escape_href(html, node->as.link.url,
                             (bufsize_t)strlen((char *)node->as.link.url));
@@ -335,20 +380,156 @@ static int S_render_node(cssg_node *node, cssg_event_type ev_type,
   return 1;
 }
 
-char *cssg_render_html(cssg_node *root, int options) {
-  char *result;
-  cssg_strbuf html = CSSG_BUF_INIT(root->mem);
+static uint64_t S_fnv1a(uint64_t h, const char *s) {
+  while (*s) {
+    h ^= (unsigned char)*s++;
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+unsigned long long cssg_html_template_hash(void) {
+  const char *pieces[] = {
+      htmlOpen,      htmlHead,     bodyOpen,     nav,
+      mainHTML,      article,      headerArticle, asideArticle,
+      mainArticle,   htmlFooter,   htmlTerminal, IMAGE_PREFIX,
+      CSSG_VERSION_STRING};
+  uint64_t h = 14695981039346656037ULL;
+  size_t i;
+
+  for (i = 0; i < sizeof(pieces) / sizeof(*pieces); i++) {
+    // Hash the terminating NUL too, so moving text from one piece to
+    // the next changes the result.
+    h = S_fnv1a(h, pieces[i]) * 1099511628211ULL;
+  }
+  return h;
+}
+
+static void S_render(cssg_node *root, struct render_state *state,
+                     int options) {
   cssg_event_type ev_type;
   cssg_node *cur;
-  struct render_state state = {&html, NULL};
-  cssg_iter *iter = cssg_iter_new(root);
+  cssg_iter iter;
+
+  cssg_iter_init(&iter, root);
+  while ((ev_type = cssg_iter_step(&iter)) != CSSG_EVENT_DONE) {
+    cur = iter.cur.node;
+    S_render_node(cur, ev_type, state, options);
+    S_flush(state, RENDER_FLUSH_SIZE);
+    if (state->error)
+      break;
+  }
+}
+
+// Bytes of page template wrapped around a document.
+static bufsize_t S_template_size(void) {
+  const char *pieces[] = {htmlOpen,      htmlHead,     bodyOpen,
+                          nav,           mainHTML,     article,
+                          headerArticle, asideArticle, mainArticle,
+                          htmlFooter,    htmlTerminal};
+  size_t size = 0;
+  size_t i;
+
+  for (i = 0; i < sizeof(pieces) / sizeof(*pieces); i++)
+    size += strlen(pieces[i]);
+  return (bufsize_t)size;
+}
+
+static void S_reserve_output(cssg_strbuf *html, cssg_node *root,
+                             int options) {
+  bufsize_t per_block = CSSG_OPT_SOURCEPOS & options ? 48 : 16;
+  bufsize_t estimate = cssg_node_estimate_output(root, per_block, 8);
+
+  if (estimate > 0)
+    cssg_strbuf_reserve(html, S_template_size() + estimate);
+}
+
+char *cssg_render_html(cssg_node *root, int options) {
+  cssg_strbuf html = CSSG_BUF_INIT(root->mem);
+  struct render_state state = {&html, NULL, NULL, NULL, 0};
+
+  S_reserve_output(&html, root, options);
+  S_render(root, &state, options);
+  return (char *)cssg_strbuf_detach(&html);
+}
+
+// Key of the HTML rendered for top-level 'block' with content hash
+// 'hash'.  Besides the options, the output depends on whether the
+// buffer is empty or ends in a newline, because cr() does, and with
+// source positions on the block's absolute first line.
+// Adds the render state to 'key' and 'hash': the options, whether the
+// output so far ends a line, and the line numbers written with sourcepos.
+static uint64_t S_fragment_key(uint64_t hash, cssg_node *block,
+                               cssg_strbuf *html, int options,
+                               cssg_strbuf *key) {
+  int state[3];
+
+  state[0] = options;
+  state[1] = html->size == 0 ? -1 : html->ptr[html->size - 1] == '\n';
+  state[2] = (options & CSSG_OPT_SOURCEPOS) ? block->start_line : 0;
+  cssg_strbuf_put(key, (const unsigned char *)state, sizeof(state));
+
+  hash = (hash ^ (uint64_t)(unsigned)state[0]) * 1099511628211ULL;
+  hash = (hash ^ (uint64_t)(int64_t)state[1]) * 1099511628211ULL;
+  hash = (hash ^ (uint64_t)(unsigned)state[2]) * 1099511628211ULL;
+  return hash;
+}
+
+char *cssg_render_html_cached(cssg_node *root, int options,
+                              cssg_fragment_cache *cache) {
+  cssg_strbuf html;
+  cssg_strbuf key;
+  struct render_state state = {&html, NULL, NULL, NULL, 0};
+  cssg_node *block;
+
+  if (cache == NULL || root->type != CSSG_NODE_DOCUMENT)
+    return cssg_render_html(root, options);
+
+  cssg_strbuf_init(root->mem, &html, 0);
+  cssg_strbuf_init(root->mem, &key, 0);
+  S_reserve_output(&html, root, options);
+  S_render_node(root, CSSG_EVENT_ENTER, &state, options);
+
+  for (block = root->first_child; block != NULL; block = block->next) {
+    uint64_t hash;
+    const unsigned char *data;
+    size_t len;
+    bufsize_t start;
+
+    cssg_strbuf_clear(&key);
+    hash = cssg_node_block_key(block, &key);
+    if (hash == 0) {
+      S_render(block, &state, options);
+      continue;
+    }
 
-  while ((ev_type = cssg_iter_next(iter)) != CSSG_EVENT_DONE) {
-    cur = cssg_iter_get_node(iter);
-    S_render_node(cur, ev_type, &state, options);
+    hash = S_fragment_key(hash, block, &html, options, &key);
+    if (cssg_fragment_cache_get(cache, hash, key.ptr, (size_t)key.size,
+                                &data, &len)) {
+      cssg_strbuf_put(&html, data, (bufsize_t)len);
+    } else {
+      start = html.size;
+      S_render(block, &state, options);
+      cssg_fragment_cache_put(cache, hash, key.ptr, (size_t)key.size,
+                              html.ptr + start, (size_t)(html.size - start));
+    }
   }
-  result = (char *)cssg_strbuf_detach(&html);
 
-  cssg_iter_free(iter);
-  return result;
+  cssg_strbuf_free(&key);
+  S_render_node(root, CSSG_EVENT_EXIT, &state, options);
+  return (char *)cssg_strbuf_detach(&html);
+}
+
+int cssg_render_html_to(cssg_node *root, int options, cssg_write_cb write,
+                        void *userdata) {
+  cssg_strbuf html = CSSG_BUF_INIT(root->mem);
+  struct render_state state = {&html, NULL, write, userdata, 0};
+
+  cssg_strbuf_grow(&html, RENDER_FLUSH_SIZE + RENDER_SLICE * 6);
+  S_render(root, &state, options);
+  if (state.error == 0 && html.size > 0)
+    state.error = write((const char *)html.ptr, (size_t)html.size, userdata);
+
+  cssg_strbuf_free(&html);
+  return state.error;
 }
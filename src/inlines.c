@@ -11,6 +11,7 @@
 #include "houdini.h"
 #include "utf8.h"
 #include "scanners.h"
+#include "simd.h"
 #include "inlines.h"
 
 static const char *EMDASH = "\xE2\x80\x94";
@@ -68,6 +69,9 @@ typedef struct {
   bufsize_t backticks[MAXBACKTICKS + 1];
   bool scanned_for_backticks;
   bool no_link_openers;
+  bool had_markers;      // a delimiter or bracket was pushed
+  cssg_node *text_node;  // text node whose content is pending in 'text'
+  cssg_strbuf text;
 } subject;
 
 static inline bool S_is_line_end_char(char c) {
@@ -83,10 +87,12 @@ static void subject_from_buf(cssg_mem *mem, int line_number, int block_offset, s
                              cssg_chunk *chunk, cssg_reference_map *refmap);
 static bufsize_t subject_find_special_char(subject *subj, int options);
 
-// Create an inline with a literal string value.
+// Create an inline with a literal string value.  'extra' bytes are
+// allocated after the node for literals stored in place.
 static inline cssg_node *make_literal(subject *subj, cssg_node_type t,
-                                       int start_column, int end_column) {
-  cssg_node *e = (cssg_node *)subj->mem->calloc(1, sizeof(*e));
+                                       int start_column, int end_column,
+                                       bufsize_t extra) {
+  cssg_node *e = (cssg_node *)subj->mem->calloc(1, sizeof(*e) + extra);
   e->mem = subj->mem;
   e->type = (uint16_t)t;
   e->start_line = e->end_line = subj->line;
@@ -105,8 +111,15 @@ static inline cssg_node *make_simple(cssg_mem *mem, cssg_node_type t) {
 }
 
 static cssg_node *make_str(subject *subj, int sc, int ec, cssg_chunk s) {
-  cssg_node *e = make_literal(subj, CSSG_NODE_TEXT, sc, ec);
+#ifndef CSSG_NO_COMPACT_NODES
+  // Text is usually short and never grows, so keep it with the node.
+  cssg_node *e = make_literal(subj, CSSG_NODE_TEXT, sc, ec, s.len + 1);
+  e->data = (unsigned char *)(e + 1);
+  e->flags |= CSSG_NODE__INLINE_DATA;
+#else
+  cssg_node *e = make_literal(subj, CSSG_NODE_TEXT, sc, ec, 0);
   e->data = (unsigned char *)subj->mem->realloc(NULL, s.len + 1);
+#endif
   if (s.data != NULL) {
     memcpy(e->data, s.data, s.len);
   }
@@ -117,7 +130,7 @@ static cssg_node *make_str(subject *subj, int sc, int ec, cssg_chunk s) {
 
 static cssg_node *make_str_from_buf(subject *subj, int sc, int ec,
                                      cssg_strbuf *buf) {
-  cssg_node *e = make_literal(subj, CSSG_NODE_TEXT, sc, ec);
+  cssg_node *e = make_literal(subj, CSSG_NODE_TEXT, sc, ec, 0);
   e->len = buf->size;
   e->data = cssg_strbuf_detach(buf);
   return e;
@@ -210,6 +223,9 @@ static void subject_from_buf(cssg_mem *mem, int line_number, int block_offset, s
   }
   e->scanned_for_backticks = false;
   e->no_link_openers = true;
+  e->had_markers = false;
+  e->text_node = NULL;
+  cssg_strbuf_init(mem, &e->text, 0);
 }
 
 static inline int isbacktick(int c) { return (c == '`'); }
@@ -411,7 +427,7 @@ static cssg_node *handle_backticks(subject *subj, int options) {
     S_normalize_code(&buf);
 
     cssg_node *node = make_literal(subj, CSSG_NODE_CODE, startpos,
-                                    endpos - openticks.len - 1);
+                                    endpos - openticks.len - 1, 0);
     node->len = buf.size;
     node->data = cssg_strbuf_detach(&buf);
     adjust_subj_node_newlines(subj, node, endpos - startpos, openticks.len, options);
@@ -543,6 +559,7 @@ static void push_delimiter(subject *subj, unsigned char c, bool can_open,
     delim->previous->next = delim;
   }
   subj->last_delim = delim;
+  subj->had_markers = true;
 }
 
 static void push_bracket(subject *subj, bool image, cssg_node *inl_text) {
@@ -557,6 +574,7 @@ static void push_bracket(subject *subj, bool image, cssg_node *inl_text) {
   b->position = subj->pos;
   b->bracket_after = false;
   subj->last_bracket = b;
+  subj->had_markers = true;
   if (!image) {
     subj->no_link_openers = false;
   }
@@ -988,9 +1006,17 @@ static cssg_node *handle_pointy_brace(subject *subj, int options) {
     const unsigned char *src = subj->input.data + subj->pos - 1;
     bufsize_t len = matchlen + 1;
     subj->pos += matchlen;
+#ifndef CSSG_NO_COMPACT_NODES
     cssg_node *node = make_literal(subj, CSSG_NODE_HTML_INLINE,
-                                    subj->pos - matchlen - 1, subj->pos - 1);
+                                    subj->pos - matchlen - 1, subj->pos - 1,
+                                    len + 1);
+    node->data = (unsigned char *)(node + 1);
+    node->flags |= CSSG_NODE__INLINE_DATA;
+#else
+    cssg_node *node = make_literal(subj, CSSG_NODE_HTML_INLINE,
+                                    subj->pos - matchlen - 1, subj->pos - 1, 0);
     node->data = (unsigned char *)subj->mem->realloc(NULL, len + 1);
+#endif
     memcpy(node->data, src, len);
     node->data[len] = 0;
     node->len = len;
@@ -1282,47 +1308,93 @@ static cssg_node *handle_newline(subject *subj) {
   }
 }
 
-static bufsize_t subject_find_special_char(subject *subj, int options) {
-  // "\r\n\\`&_*[]<!"
-  static const int8_t SPECIAL_CHARS[256] = {
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 0, 1,
-      1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
-
-  // " ' . -
-  static const char SMART_PUNCT_CHARS[] = {
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 1, 1, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-      0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-  };
+// Bytes that may start something other than literal text; with
+// CSSG_OPT_SMART, also the smart punctuation characters " ' . -
+/* "\n\r!&*<[\\]_`", generated by tools/make_byteset.py */
+static const cssg_byteset SPECIAL_CHARS = {
+    {0x10, 0x02, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00,
+     0x00, 0x00, 0x03, 0x08, 0x0C, 0x09, 0x00, 0x08},
+    {0x01, 0x00, 0x02, 0x04, 0x00, 0x08, 0x10, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
+
+/* "\n\r!\"&'*-.<[\\]_`", generated by tools/make_byteset.py */
+static const cssg_byteset SMART_SPECIAL_CHARS = {
+    {0x10, 0x02, 0x02, 0x00, 0x00, 0x00, 0x02, 0x02,
+     0x00, 0x00, 0x03, 0x08, 0x0C, 0x0B, 0x02, 0x08},
+    {0x01, 0x00, 0x02, 0x04, 0x00, 0x08, 0x10, 0x00,
+     0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}};
 
+static bufsize_t subject_find_special_char(subject *subj, int options) {
+  const cssg_byteset *set =
+      (options & CSSG_OPT_SMART) ? &SMART_SPECIAL_CHARS : &SPECIAL_CHARS;
   bufsize_t n = subj->pos + 1;
 
-  while (n < subj->input.len) {
-    if (SPECIAL_CHARS[subj->input.data[n]])
-      return n;
-    if (options & CSSG_OPT_SMART && SMART_PUNCT_CHARS[subj->input.data[n]])
-      return n;
-    n++;
+  if (n >= subj->input.len)
+    return subj->input.len;
+
+  return n + cssg_byteset_find(set, subj->input.data + n, subj->input.len - n);
+}
+
+// Delimiter and bracket text must stay in nodes of its own until emphasis
+// and links are resolved.  Inlines are appended in source order, so a
+// node that is still on either stack can only be the last child if it is
+// the innermost entry.
+static inline bool S_is_marker_text(subject *subj, cssg_node *node) {
+  return (subj->last_delim && subj->last_delim->inl_text == node) ||
+         (subj->last_bracket && subj->last_bracket->inl_text == node);
+}
+
+// Store the merged content of subj->text_node back in the node.
+static void S_flush_text(subject *subj) {
+  cssg_node *node = subj->text_node;
+
+  if (node == NULL)
+    return;
+  cssg_node_free_data(node);
+  node->data = (unsigned char *)subj->mem->realloc(NULL, subj->text.size + 1);
+  memcpy(node->data, subj->text.ptr, subj->text.size + 1);
+  node->len = subj->text.size;
+  subj->text_node = NULL;
+  cssg_strbuf_clear(&subj->text);
+}
+
+// Text following other text is merged into the preceding node as it is
+// parsed, so adjacent text only needs to be consolidated afterwards where
+// delimiters or brackets separated it.  Returns the node new text can be
+// merged into, or NULL.
+static inline cssg_node *S_text_target(subject *subj, cssg_node *parent) {
+  cssg_node *prev = parent->last_child;
+
+  if (prev == NULL || prev->type != CSSG_NODE_TEXT ||
+      S_is_marker_text(subj, prev))
+    return NULL;
+  return prev;
+}
+
+static void S_merge_text(subject *subj, cssg_node *target,
+                         const unsigned char *data, bufsize_t len,
+                         int end_column) {
+  if (subj->text_node != target) {
+    S_flush_text(subj);
+    subj->text_node = target;
+    cssg_strbuf_put(&subj->text, target->data, target->len);
   }
+  cssg_strbuf_put(&subj->text, data, len);
+  target->end_column = end_column;
+}
+
+// Append an inline to parent, merging text into preceding text.
+static void S_append_inline(subject *subj, cssg_node *parent,
+                            cssg_node *inl) {
+  cssg_node *target;
 
-  return subj->input.len;
+  if (inl->type == CSSG_NODE_TEXT && !S_is_marker_text(subj, inl) &&
+      (target = S_text_target(subj, parent)) != NULL) {
+    S_merge_text(subj, target, inl->data, inl->len, inl->end_column);
+    cssg_node_free(inl);
+  } else {
+    append_child(parent, inl);
+  }
 }
 
 // Parse an inline, advancing subject, and add it as a child of parent.
@@ -1330,6 +1402,7 @@ static bufsize_t subject_find_special_char(subject *subj, int options) {
 static int parse_inline(subject *subj, cssg_node *parent, int options) {
   cssg_node *new_inl = NULL;
   cssg_chunk contents;
+  cssg_node *target;
   unsigned char c;
   bufsize_t startpos, endpos;
   c = peek_char(subj);
@@ -1394,10 +1467,16 @@ static int parse_inline(subject *subj, cssg_node *parent, int options) {
       cssg_chunk_rtrim(&contents);
     }
 
-    new_inl = make_str(subj, startpos, endpos - 1, contents);
+    // Plain text is merged without creating a node for it first.
+    target = S_text_target(subj, parent);
+    if (target != NULL)
+      S_merge_text(subj, target, contents.data, contents.len,
+                   endpos + subj->column_offset + subj->block_offset);
+    else
+      new_inl = make_str(subj, startpos, endpos - 1, contents);
   }
   if (new_inl != NULL) {
-    append_child(parent, new_inl);
+    S_append_inline(subj, parent, new_inl);
   }
 
   return 1;
@@ -1415,6 +1494,8 @@ void cssg_parse_inlines(cssg_mem *mem, cssg_node *parent,
 
   while (!is_eof(&subj) && parse_inline(&subj, parent, options))
     ;
+  S_flush_text(&subj);
+  cssg_strbuf_free(&subj.text);
 
   process_emphasis(&subj, 0);
   // free bracket and delim stack
@@ -1424,6 +1505,11 @@ void cssg_parse_inlines(cssg_mem *mem, cssg_node *parent,
   while (subj.last_bracket) {
     pop_bracket(&subj);
   }
+
+  // Unmatched delimiters and brackets, and text moved around emphasis and
+  // links, can still leave adjacent text nodes.
+  if (subj.had_markers)
+    cssg_consolidate_text_nodes(parent);
 }
 
 // Parse zero or more space characters, including at most one newline.
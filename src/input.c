@@ -0,0 +1,176 @@
+#if !defined(_WIN32) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+#define CSSG_NO_MMAP
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "cssg.h"
+
+// Whole-file input for cssg_parse_path() and callers that want the
+// source bytes themselves.  Regular files are mapped read-only so the
+// block parser can process their lines in place; anything that cannot
+// be mapped (pipes, character devices, empty files, platforms without
+// mmap) is read into a single malloc'd buffer instead.
+
+#define INPUT_READ_CHUNK (64 * 1024)
+
+#ifdef CSSG_NO_MMAP
+
+int cssg_input_open(cssg_input *input, const char *path) {
+  FILE *fp;
+  char *data = NULL;
+  size_t size = 0;
+  size_t capacity = 0;
+  size_t bytes;
+
+  input->data = NULL;
+  input->len = 0;
+  input->mapped = 0;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+    return -1;
+
+  do {
+    if (size == capacity) {
+      char *grown;
+      capacity = capacity ? capacity * 2 : INPUT_READ_CHUNK;
+      grown = (char *)realloc(data, capacity);
+      if (grown == NULL) {
+        free(data);
+        fclose(fp);
+        errno = ENOMEM;
+        return -1;
+      }
+      data = grown;
+    }
+    bytes = fread(data + size, 1, capacity - size, fp);
+    size += bytes;
+  } while (bytes > 0);
+
+  if (ferror(fp)) {
+    free(data);
+    fclose(fp);
+    errno = EIO;
+    return -1;
+  }
+
+  fclose(fp);
+  input->data = data;
+  input->len = size;
+  return 0;
+}
+
+void cssg_input_close(cssg_input *input) {
+  free((void *)input->data);
+  input->data = NULL;
+  input->len = 0;
+}
+
+#else
+
+// Reads fd to the end.  'hint' is the expected size, or 0 if unknown.
+static int read_all(cssg_input *input, int fd, size_t hint) {
+  char *data = NULL;
+  size_t size = 0;
+  size_t capacity = hint ? hint + 1 : INPUT_READ_CHUNK;
+  ssize_t bytes;
+
+  for (;;) {
+    if (data == NULL || size == capacity) {
+      char *grown;
+      if (data != NULL)
+        capacity *= 2;
+      grown = (char *)realloc(data, capacity);
+      if (grown == NULL) {
+        free(data);
+        errno = ENOMEM;
+        return -1;
+      }
+      data = grown;
+    }
+    bytes = read(fd, data + size, capacity - size);
+    if (bytes < 0) {
+      if (errno == EINTR)
+        continue;
+      free(data);
+      return -1;
+    }
+    if (bytes == 0)
+      break;
+    size += (size_t)bytes;
+  }
+
+  input->data = data;
+  input->len = size;
+  input->mapped = 0;
+  return 0;
+}
+
+int cssg_input_open(cssg_input *input, const char *path) {
+  struct stat st;
+  void *map;
+  int fd;
+  int saved;
+  int rc;
+
+  input->data = NULL;
+  input->len = 0;
+  input->mapped = 0;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) != 0) {
+    saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+
+  if (S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (unsigned long long)st.st_size <= (size_t)-1) {
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map != MAP_FAILED) {
+#ifdef POSIX_MADV_SEQUENTIAL
+      posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+      close(fd);
+      input->data = (const char *)map;
+      input->len = (size_t)st.st_size;
+      input->mapped = 1;
+      return 0;
+    }
+  }
+
+  rc = read_all(input, fd, S_ISREG(st.st_mode) ? (size_t)st.st_size : 0);
+  saved = errno;
+  close(fd);
+  errno = saved;
+  return rc;
+}
+
+void cssg_input_close(cssg_input *input) {
+  if (input->mapped)
+    munmap((void *)input->data, input->len);
+  else
+    free((void *)input->data);
+  input->data = NULL;
+  input->len = 0;
+  input->mapped = 0;
+}
+
+#endif
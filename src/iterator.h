@@ -5,7 +5,11 @@
 extern "C" {
 #endif
 
+#include <assert.h>
+#include <stdbool.h>
+
 #include "cssg.h"
+#include "node.h"
 
 typedef struct {
   cssg_event_type ev_type;
@@ -19,6 +23,65 @@ struct cssg_iter {
   cssg_iter_state next;
 };
 
+#define CSSG_ITER_LEAF_MASK                                                   \
+  ((1 << CSSG_NODE_HTML_BLOCK) | (1 << CSSG_NODE_THEMATIC_BREAK) |            \
+   (1 << CSSG_NODE_CODE_BLOCK) | (1 << CSSG_NODE_TEXT) |                      \
+   (1 << CSSG_NODE_SOFTBREAK) | (1 << CSSG_NODE_LINEBREAK) |                  \
+   (1 << CSSG_NODE_CODE) | (1 << CSSG_NODE_HTML_INLINE))
+
+// Starts a walk of 'root' in caller-provided storage, usually on the
+// stack.  Such an iterator needs no cssg_iter_free().
+static inline void cssg_iter_init(cssg_iter *iter, cssg_node *root) {
+  iter->mem = root->mem;
+  iter->root = root;
+  iter->cur.ev_type = CSSG_EVENT_NONE;
+  iter->cur.node = NULL;
+  iter->next.ev_type = CSSG_EVENT_ENTER;
+  iter->next.node = root;
+}
+
+// Inline body of cssg_iter_next(), for the renderers' inner loops.  The
+// current node is then in iter->cur.node.
+static inline cssg_event_type cssg_iter_step(cssg_iter *iter) {
+  cssg_event_type ev_type = iter->next.ev_type;
+  cssg_node *node = iter->next.node;
+
+  iter->cur.ev_type = ev_type;
+  iter->cur.node = node;
+
+  if (ev_type == CSSG_EVENT_DONE) {
+    return ev_type;
+  }
+
+  /* roll forward to next item, setting both fields */
+  if (ev_type == CSSG_EVENT_ENTER &&
+      ((1 << node->type) & CSSG_ITER_LEAF_MASK) == 0) {
+    if (node->first_child == NULL) {
+      /* stay on this node but exit */
+      iter->next.ev_type = CSSG_EVENT_EXIT;
+    } else {
+      iter->next.ev_type = CSSG_EVENT_ENTER;
+      iter->next.node = node->first_child;
+    }
+  } else if (node == iter->root) {
+    /* don't move past root */
+    iter->next.ev_type = CSSG_EVENT_DONE;
+    iter->next.node = NULL;
+  } else if (node->next) {
+    iter->next.ev_type = CSSG_EVENT_ENTER;
+    iter->next.node = node->next;
+  } else if (node->parent) {
+    iter->next.ev_type = CSSG_EVENT_EXIT;
+    iter->next.node = node->parent;
+  } else {
+    assert(false);
+    iter->next.ev_type = CSSG_EVENT_DONE;
+    iter->next.node = NULL;
+  }
+
+  return ev_type;
+}
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,7 +3,10 @@
 #include <stdlib.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <sys/types.h>
 #include <string.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "cssg.h"
 #include "node.h"
@@ -11,6 +14,10 @@
 #if defined(_WIN32) && !defined(__CYGWIN__)
 #include <io.h>
 #include <fcntl.h>
+#include <direct.h>
+#define cssg_mkdir(path) _mkdir(path)
+#else
+#define cssg_mkdir(path) mkdir(path, 0777)
 #endif
 
 #include "toml.h"
@@ -24,15 +31,83 @@ typedef enum {
 } writer_format;
 
 #define MAX_FILENAME_LENGTH 256
-#define MAX_FILES 100
+#define MAX_PATH_LENGTH 1024
+#define MAX_JOBS 256
+
+#define TOPIC_DIR "topics"
+#define DEFAULT_OUTPUT_DIR "publish"
+#define MANIFEST_NAME ".cssg-manifest"
+#define MANIFEST_VERSION 1
 
 const char *testFiles[2] = {
   "short-sample.md",
   "test.md"
 };
 
+// What the last build recorded for a topic: a topic is rebuilt only
+// when its source, the HTML template or the options differ from this.
+typedef struct {
+  unsigned long long source_hash;
+  unsigned long long template_hash;
+  unsigned long long output_hash;
+  long long source_size;
+  long long source_mtime;
+  int options;
+} manifest_entry;
+
+typedef struct {
+  char name[MAX_FILENAME_LENGTH];
+  manifest_entry entry;
+} manifest_record;
+
+typedef enum {
+  TOPIC_FAILED = -1,
+  TOPIC_BUILT,
+  TOPIC_UNCHANGED,
+} topic_status;
+
+// One entry of iaList.txt. Workers fill in `status`, `error` and
+// `entry`; the main thread reports them in list order once the pool has
+// joined, so the build log does not depend on scheduling.
+typedef struct {
+  char name[MAX_FILENAME_LENGTH];
+  topic_status status;
+  char error[MAX_PATH_LENGTH + 64]; // room for an output path
+  manifest_entry entry;
+  const manifest_entry *previous;
+} topic;
+
+typedef struct {
+  topic *topics;
+  int count;
+  int next;
+  int options;
+  writer_format writer;
+  const char *output_dir;
+  unsigned long long template_hash;
+  // Sources modified at or after this time may have changed without
+  // their size or mtime changing, so they are always rehashed.
+  long long manifest_time;
+  int force;
+  const cssg_reference_map *links;
+  pthread_mutex_t lock;
+} build_queue;
+
 void print_usage(void) {
-  printf("Usage:   cssg\n");
+  printf("Usage:   cssg [OPTIONS]\n");
+  printf("Options:\n");
+  printf("  --jobs, -j N       Build topics with N worker threads, writing\n");
+  printf("                     each topic to its own file in the output dir\n");
+  printf("  --output-dir DIR   Output directory for per-topic files, implies\n");
+  printf("                     --jobs 1 when --jobs is not given (default: %s)\n",
+         DEFAULT_OUTPUT_DIR);
+  printf("  --force            Rebuild every topic, ignoring the build manifest\n");
+  printf("                     kept in the output dir\n");
+  printf("  --links FILE       Resolve link labels a topic does not define from\n");
+  printf("                     the definitions in FILE (Markdown or .toml)\n");
+  printf("  --front-matter     Read TOML front matter between +++ lines at\n");
+  printf("                     the start of each topic\n");
+  printf("  --help, -h         Print usage information\n");
 }
 
 void list_files_recursively(const char *path) {
@@ -70,13 +145,76 @@ void list_files_recursively(const char *path) {
     closedir(dp);
 }
 
-static void render_topic(cssg_node *document, writer_format writer, int options) {
+static const char *output_extension(writer_format writer) {
+  switch (writer) {
+  case FORMAT_XML:
+    return ".xml";
+  case FORMAT_MAN:
+    return ".1";
+  case FORMAT_COMMONMARK:
+    return ".md";
+  default:
+    return ".html";
+  }
+}
+
+// Create every missing directory leading up to the last '/' in path.
+static void make_parent_dirs(const char *path) {
+  char dir[1024];
+  size_t len = strlen(path);
+  size_t i;
+
+  if (len >= sizeof(dir))
+    return;
+  memcpy(dir, path, len + 1);
+  for (i = 1; i < len; i++) {
+    if (dir[i] == '/') {
+      dir[i] = '\0';
+      cssg_mkdir(dir);
+      dir[i] = '/';
+    }
+  }
+}
+
+#define HASH_INIT 14695981039346656037ULL
+
+static unsigned long long hash_update(unsigned long long h, const char *data,
+                                      size_t len) {
+  size_t i;
+
+  for (i = 0; i < len; i++) {
+    h ^= (unsigned char)data[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+static unsigned long long hash_bytes(const char *data, size_t len) {
+  return hash_update(HASH_INIT, data, len);
+}
+
+typedef struct {
+  FILE *out;
+  unsigned long long hash;
+} topic_sink;
+
+static int write_output(const char *data, size_t len, void *userdata) {
+  topic_sink *sink = (topic_sink *)userdata;
+
+  sink->hash = hash_update(sink->hash, data, len);
+  return len == 0 || fwrite(data, len, 1, sink->out) == 1 ? 0 : -1;
+}
+
+// Render a topic to sink->out, hashing the output as it goes.  HTML is
+// streamed; the other formats are rendered to a string first.
+static int render_topic(cssg_node *document, writer_format writer, int options,
+                        topic_sink *sink) {
   char *result;
+  int rc;
 
   switch (writer) {
   case FORMAT_HTML:
-    result = cssg_render_html(document, options);
-    break;
+    return cssg_render_html_to(document, options, write_output, sink);
   case FORMAT_XML:
     result = cssg_render_xml(document, options);
     break;
@@ -90,75 +228,490 @@ static void render_topic(cssg_node *document, writer_format writer, int options)
     fprintf(stderr, "Unknown format %d\n", writer);
     exit(1);
   }
-  fwrite(result, strlen(result), 1, stdout);
+
+  rc = write_output(result, strlen(result), sink);
   document->mem->free(result);
+  return rc;
 }
 
-int main(int argc, char *argv[]) {
-  FILE *testFiles;
-  char fList[MAX_FILES][MAX_FILENAME_LENGTH];
-  int fileCount = 0;
-  int *files;
-  char buffer[8192];
-  cssg_parser *parser;
-  size_t bytes;
-  cssg_node *document;
-  int options = CSSG_OPT_DEFAULT;
+static int compare_records(const void *a, const void *b) {
+  return strcmp(((const manifest_record *)a)->name,
+                ((const manifest_record *)b)->name);
+}
 
-#if defined(_WIN32) && !defined(__CYGWIN__)
-  _setmode(_fileno(stdin), _O_BINARY);
-  _setmode(_fileno(stdout), _O_BINARY);
-#endif
+static int compare_record_name(const void *key, const void *rec) {
+  return strcmp((const char *)key, ((const manifest_record *)rec)->name);
+}
 
-  testFiles = fopen("iaList.txt", "r");
-  if (testFiles == NULL) {
-    fprintf(stderr, "Error opening file %s: %s %s\n", "iaList.txt", strerror(errno), argv[1]);
-    exit(1);
+// Load the manifest written by the previous build, sorted by topic name.
+// A missing or unreadable manifest simply means everything is rebuilt.
+static int read_manifest(const char *path, manifest_record **out,
+                         long long *written) {
+  FILE *fp;
+  char line[MAX_FILENAME_LENGTH + 128];
+  manifest_record *records = NULL;
+  int count = 0;
+  int capacity = 0;
+  int version;
+
+  *out = NULL;
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return 0;
+
+  if (fgets(line, sizeof(line), fp) == NULL ||
+      sscanf(line, "cssg-manifest %d %lld", &version, written) != 2 ||
+      version != MANIFEST_VERSION) {
+    fclose(fp);
+    return 0;
+  }
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    manifest_entry e;
+    int name_start = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    if (sscanf(line, "%llx %llx %x %llx %lld %lld %n", &e.source_hash,
+               &e.template_hash, (unsigned int *)&e.options, &e.output_hash,
+               &e.source_size, &e.source_mtime, &name_start) < 6 ||
+        name_start == 0 || line[name_start] == '\0')
+      continue;
+
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      records =
+          (manifest_record *)realloc(records, capacity * sizeof(*records));
+      if (records == NULL) {
+        fprintf(stderr, "Out of memory reading %s\n", path);
+        exit(1);
+      }
+    }
+    snprintf(records[count].name, MAX_FILENAME_LENGTH, "%s",
+             line + name_start);
+    records[count].entry = e;
+    count++;
+  }
+
+  fclose(fp);
+  qsort(records, count, sizeof(*records), compare_records);
+  *out = records;
+  return count;
+}
+
+// Write the manifest for this build, in topic list order. Topics that
+// failed are left out so the next build retries them. The file is
+// written next to its final location and renamed into place.
+static int write_manifest(const char *path, const topic *topics, int count,
+                          long long build_time) {
+  char tmp_path[1024 + sizeof(".tmp")];
+  FILE *fp;
+  int i;
+
+  snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+  fp = fopen(tmp_path, "w");
+  if (fp == NULL)
+    return -1;
+
+  fprintf(fp, "cssg-manifest %d %lld\n", MANIFEST_VERSION, build_time);
+  for (i = 0; i < count; i++) {
+    const manifest_entry *e = &topics[i].entry;
+    if (topics[i].status == TOPIC_FAILED)
+      continue;
+    fprintf(fp, "%016llx %016llx %08x %016llx %lld %lld %s\n",
+            e->source_hash, e->template_hash, (unsigned int)e->options,
+            e->output_hash, e->source_size, e->source_mtime, topics[i].name);
   }
 
-  while (fgets(fList[fileCount], MAX_FILENAME_LENGTH, testFiles) != NULL && fileCount < MAX_FILES) {
+  if (fclose(fp) != 0) {
+    remove(tmp_path);
+    return -1;
+  }
+  remove(path);
+  return rename(tmp_path, path);
+}
+
+static int read_topic_list(const char *list_path, topic **out) {
+  FILE *fp;
+  char line[MAX_FILENAME_LENGTH];
+  topic *topics = NULL;
+  int count = 0;
+  int capacity = 0;
+
+  fp = fopen(list_path, "r");
+  if (fp == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), fp) != NULL) {
     // Remove the newline character from the filename, if present
-    fList[fileCount][strcspn(fList[fileCount], "\n")] = '\0';
-    fileCount++;
+    line[strcspn(line, "\r\n")] = '\0';
+    if (line[0] == '\0')
+      continue;
+    if (count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      topics = (topic *)realloc(topics, capacity * sizeof(*topics));
+      if (topics == NULL) {
+        fprintf(stderr, "Out of memory reading %s\n", list_path);
+        exit(1);
+      }
+    }
+    memset(&topics[count], 0, sizeof(topic));
+    memcpy(topics[count].name, line, strlen(line) + 1);
+    count++;
   }
 
-  // Close the list file
-  fclose(testFiles);
+  fclose(fp);
+  *out = topics;
+  return count;
+}
 
-  for (int i = 0; i < fileCount; i++) {
-    files = (int *)calloc(argc, sizeof(*files));
+// Load the shared link definitions once for the whole build, hashing
+// the file so the manifest can tell when they change.
+static cssg_reference_map *load_links(const char *path, int options,
+                                      unsigned long long *hash) {
+  cssg_input source;
 
-    parser = cssg_parser_new(options);
+  if (cssg_input_open(&source, path) != 0)
+    return NULL;
+  *hash = hash_bytes(source.data, source.len);
+  cssg_input_close(&source);
+  return cssg_reference_map_load(path, options);
+}
 
-    char path[MAX_FILENAME_LENGTH] = "";
-    strcat(path, "topics/");
-    strcat(path, fList[i]);
-    FILE *fp = fopen(path, "rb");
-    if (fp == NULL) {
-      fprintf(stderr, "Error opening file %s: %s\n", fList[i], strerror(errno));
-      exit(1);
+// Parse a topic's source into this thread's arena, falling back to the
+// shared link definitions for labels the topic does not define.
+static cssg_node *parse_source(const cssg_input *source, int options,
+                               const cssg_reference_map *links) {
+  cssg_parser *parser =
+      cssg_parser_new_with_mem(options, cssg_get_arena_mem_allocator());
+  cssg_node *document;
+
+  if (links != NULL)
+    cssg_parser_set_shared_references(parser, links);
+  cssg_parser_feed(parser, source->data, source->len);
+  document = cssg_parser_finish(parser);
+  cssg_parser_free(parser);
+  return document;
+}
+
+static cssg_node *parse_topic(topic *t, int options,
+                              const cssg_reference_map *links) {
+  char path[MAX_FILENAME_LENGTH + sizeof(TOPIC_DIR)];
+  cssg_node *document;
+  cssg_input source;
+
+  snprintf(path, sizeof(path), "%s/%s", TOPIC_DIR, t->name);
+  if (cssg_input_open(&source, path) != 0) {
+    snprintf(t->error, sizeof(t->error), "Error opening file %s: %s",
+             t->name, strerror(errno));
+    return NULL;
+  }
+  document = parse_source(&source, options, links);
+  cssg_input_close(&source);
+  return document;
+}
+
+// Parse and render one topic into its own file below output_dir,
+// unless the manifest shows the existing output is still current.
+static topic_status build_topic(build_queue *queue, topic *t) {
+  char src_path[MAX_FILENAME_LENGTH + sizeof(TOPIC_DIR)];
+  char out_path[MAX_PATH_LENGTH];
+  const manifest_entry *prev = t->previous;
+  manifest_entry *entry = &t->entry;
+  struct stat st;
+  cssg_node *document;
+  cssg_input source;
+  size_t name_len;
+  const char *dot;
+  FILE *out;
+  int ok;
+  int current;
+
+  snprintf(src_path, sizeof(src_path), "%s/%s", TOPIC_DIR, t->name);
+  if (stat(src_path, &st) != 0) {
+    snprintf(t->error, sizeof(t->error), "Error opening file %s: %s",
+             t->name, strerror(errno));
+    return TOPIC_FAILED;
+  }
+
+  dot = strrchr(t->name, '.');
+  name_len = dot && !strchr(dot, '/') ? (size_t)(dot - t->name)
+                                      : strlen(t->name);
+  snprintf(out_path, sizeof(out_path), "%s/%.*s%s", queue->output_dir,
+           (int)name_len, t->name, output_extension(queue->writer));
+
+  entry->template_hash = queue->template_hash;
+  entry->options = queue->options;
+  entry->source_size = (long long)st.st_size;
+  entry->source_mtime = (long long)st.st_mtime;
+
+  current = !queue->force && prev != NULL &&
+            prev->options == entry->options &&
+            prev->template_hash == entry->template_hash &&
+            stat(out_path, &st) == 0;
+
+  // Fast path: size and mtime are unchanged and the mtime is old enough
+  // that a later edit would have moved it.
+  if (current && prev->source_size == entry->source_size &&
+      prev->source_mtime == entry->source_mtime &&
+      entry->source_mtime < queue->manifest_time) {
+    entry->source_hash = prev->source_hash;
+    entry->output_hash = prev->output_hash;
+    return TOPIC_UNCHANGED;
+  }
+
+  if (cssg_input_open(&source, src_path) != 0) {
+    snprintf(t->error, sizeof(t->error), "Error reading file %s: %s",
+             t->name, strerror(errno));
+    return TOPIC_FAILED;
+  }
+  entry->source_hash = hash_bytes(source.data, source.len);
+
+  if (current && prev->source_hash == entry->source_hash) {
+    cssg_input_close(&source);
+    entry->output_hash = prev->output_hash;
+    return TOPIC_UNCHANGED;
+  }
+
+  document = parse_source(&source, queue->options, queue->links);
+  cssg_input_close(&source);
+
+  make_parent_dirs(out_path);
+  out = fopen(out_path, "wb");
+  if (out == NULL) {
+    snprintf(t->error, sizeof(t->error), "Error opening file %s: %s",
+             out_path, strerror(errno));
+    ok = 0;
+  } else {
+    topic_sink sink = {out, HASH_INIT};
+    ok = render_topic(document, queue->writer, queue->options, &sink) == 0;
+    entry->output_hash = sink.hash;
+    if (fclose(out) != 0 || !ok) {
+      snprintf(t->error, sizeof(t->error), "Error writing file %s",
+               out_path);
+      ok = 0;
     }
+  }
 
-    while ((bytes = fread(buffer, 1, sizeof(buffer), fp)) > 0) {
-      cssg_parser_feed(parser, buffer, bytes);
-      if (bytes < sizeof(buffer)) {
-        break;
-      }
+  // The parser, the document and the render buffer all live in this
+  // thread's arena.
+  cssg_arena_reset();
+  return ok ? TOPIC_BUILT : TOPIC_FAILED;
+}
+
+static void *build_worker(void *arg) {
+  build_queue *queue = (build_queue *)arg;
+  int i;
+
+  for (;;) {
+    pthread_mutex_lock(&queue->lock);
+    i = queue->next < queue->count ? queue->next++ : -1;
+    pthread_mutex_unlock(&queue->lock);
+
+    if (i < 0) {
+      cssg_arena_release();
+      return NULL;
     }
 
-    fclose(fp);
+    queue->topics[i].status = build_topic(queue, &queue->topics[i]);
+  }
+}
+
+// Build all topics with a pool of `jobs` threads pulling from a shared
+// index, skipping topics the manifest in output_dir shows are current.
+// Returns the number of topics that failed.  'links_hash' covers the
+// shared link definitions, which affect every topic.
+static int build_parallel(topic *topics, int count, int jobs,
+                          writer_format writer, int options,
+                          const char *output_dir, int force,
+                          const cssg_reference_map *links,
+                          unsigned long long links_hash) {
+  pthread_t threads[MAX_JOBS];
+  char manifest_path[1024];
+  manifest_record *records;
+  int record_count;
+  build_queue queue;
+  long long build_time = (long long)time(NULL);
+  int started = 0;
+  int failed = 0;
+  int built = 0;
+  int i;
+
+  snprintf(manifest_path, sizeof(manifest_path), "%s/%s", output_dir,
+           MANIFEST_NAME);
+
+  queue.topics = topics;
+  queue.count = count;
+  queue.next = 0;
+  queue.options = options;
+  queue.writer = writer;
+  queue.output_dir = output_dir;
+  queue.template_hash = cssg_html_template_hash();
+  if (links != NULL)
+    queue.template_hash = hash_update(queue.template_hash,
+                                      (const char *)&links_hash,
+                                      sizeof(links_hash));
+  queue.links = links;
+  queue.manifest_time = 0;
+  queue.force = force;
+  pthread_mutex_init(&queue.lock, NULL);
+
+  record_count = read_manifest(manifest_path, &records, &queue.manifest_time);
+  for (i = 0; i < count; i++) {
+    manifest_record *rec = NULL;
+    if (record_count > 0)
+      rec = (manifest_record *)bsearch(topics[i].name, records, record_count,
+                                       sizeof(*records), compare_record_name);
+    topics[i].previous = rec ? &rec->entry : NULL;
+  }
+
+  if (jobs > count)
+    jobs = count;
+
+  for (i = 0; i < jobs; i++) {
+    if (pthread_create(&threads[started], NULL, build_worker, &queue) != 0)
+      break;
+    started++;
+  }
+
+  // If no thread could be started, build on the calling thread instead.
+  if (started == 0)
+    build_worker(&queue);
 
-    document = cssg_parser_finish(parser);
-    cssg_parser_free(parser);
+  for (i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
 
-    // writer options: FORMAT_MAN, FORMAT_HTML, FORMAT_XML, FORMAT_COMMONMARK
-    render_topic(document, FORMAT_HTML, options);
+  pthread_mutex_destroy(&queue.lock);
 
-    cssg_node_free(document);
+  for (i = 0; i < count; i++) {
+    if (topics[i].status == TOPIC_FAILED) {
+      fprintf(stderr, "%s\n", topics[i].error);
+      failed++;
+    } else if (topics[i].status == TOPIC_BUILT) {
+      built++;
+    }
+  }
+
+  if (write_manifest(manifest_path, topics, count, build_time) != 0)
+    fprintf(stderr, "Error writing file %s: %s\n", manifest_path,
+            strerror(errno));
+
+  fprintf(stderr, "Rendered %d of %d topics (%d unchanged)\n", built, count,
+          count - built - failed);
+
+  free(records);
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  topic *topics = NULL;
+  int fileCount;
+  cssg_node *document;
+  topic_sink sink;
+  int options = CSSG_OPT_DEFAULT;
+  writer_format writer = FORMAT_HTML;
+  const char *output_dir = DEFAULT_OUTPUT_DIR;
+  int jobs = 0;
+  int force = 0;
+  const char *links_path = NULL;
+  cssg_reference_map *links = NULL;
+  unsigned long long links_hash = 0;
+  int i;
+
+#if defined(_WIN32) && !defined(__CYGWIN__)
+  _setmode(_fileno(stdin), _O_BINARY);
+  _setmode(_fileno(stdout), _O_BINARY);
+#endif
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+      char *end;
+      i += 1;
+      if (i < argc) {
+        jobs = (int)strtol(argv[i], &end, 10);
+        if (*end != '\0' || jobs < 1 || jobs > MAX_JOBS) {
+          fprintf(stderr, "Invalid number of jobs: %s (1-%d)\n", argv[i],
+                  MAX_JOBS);
+          exit(1);
+        }
+      } else {
+        fprintf(stderr, "No argument provided for %s\n", argv[i - 1]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--output-dir") == 0) {
+      i += 1;
+      if (i < argc) {
+        output_dir = argv[i];
+        if (jobs == 0)
+          jobs = 1;
+      } else {
+        fprintf(stderr, "No argument provided for %s\n", argv[i - 1]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--links") == 0) {
+      i += 1;
+      if (i < argc) {
+        links_path = argv[i];
+      } else {
+        fprintf(stderr, "No argument provided for %s\n", argv[i - 1]);
+        exit(1);
+      }
+    } else if (strcmp(argv[i], "--force") == 0) {
+      force = 1;
+    } else if (strcmp(argv[i], "--front-matter") == 0) {
+      options |= CSSG_OPT_FRONT_MATTER;
+    } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+      print_usage();
+      exit(0);
+    } else {
+      print_usage();
+      exit(1);
+    }
+  }
+
+  if (links_path != NULL) {
+    links = load_links(links_path, options, &links_hash);
+    if (links == NULL) {
+      fprintf(stderr, "Error loading links %s: %s\n", links_path,
+              strerror(errno));
+      exit(1);
+    }
+  }
 
-    free(files);
+  fileCount = read_topic_list("iaList.txt", &topics);
+  if (fileCount < 0) {
+    fprintf(stderr, "Error opening file %s: %s\n", "iaList.txt",
+            strerror(errno));
+    exit(1);
   }
-  list_files_recursively("topics");
+
+  if (jobs > 0) {
+    cssg_mkdir(output_dir);
+    if (build_parallel(topics, fileCount, jobs, writer, options, output_dir,
+                       force, links, links_hash) != 0) {
+      free(topics);
+      cssg_reference_map_free(links);
+      exit(1);
+    }
+  } else {
+    for (i = 0; i < fileCount; i++) {
+      document = parse_topic(&topics[i], options, links);
+      if (document == NULL) {
+        fprintf(stderr, "%s\n", topics[i].error);
+        exit(1);
+      }
+
+      // writer options: FORMAT_MAN, FORMAT_HTML, FORMAT_XML, FORMAT_COMMONMARK
+      sink.out = stdout;
+      sink.hash = HASH_INIT;
+      render_topic(document, writer, options, &sink);
+      cssg_arena_reset();
+    }
+    cssg_arena_release();
+  }
+
+  free(topics);
+  cssg_reference_map_free(links);
+  list_files_recursively(TOPIC_DIR);
 
   return 0;
 }
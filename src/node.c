@@ -5,6 +5,7 @@
 #include "node.h"
 
 static void S_node_unlink(cssg_node *node);
+static void S_node_changed(cssg_node *node);
 
 static inline bool S_is_block(cssg_node *node) {
   if (node == NULL) {
@@ -73,6 +74,7 @@ static bool S_can_contain(cssg_node *node, cssg_node *child) {
 
 cssg_node *cssg_node_new_with_mem(cssg_node_type type, cssg_mem *mem) {
   cssg_node *node = (cssg_node *)mem->calloc(1, sizeof(*node));
+
   node->mem = mem;
   node->type = (uint16_t)type;
 
@@ -101,6 +103,14 @@ cssg_node *cssg_node_new(cssg_node_type type) {
   return cssg_node_new_with_mem(type, &DEFAULT_MEM_ALLOCATOR);
 }
 
+void cssg_node_free_data(cssg_node *node) {
+  if (node->flags & CSSG_NODE__INLINE_DATA)
+    node->flags &= ~CSSG_NODE__INLINE_DATA;
+  else
+    node->mem->free(node->data);
+  node->data = NULL;
+}
+
 // Free a cssg_node list and any children.
 static void S_free_nodes(cssg_node *e) {
   cssg_mem *mem = e->mem;
@@ -115,7 +125,7 @@ static void S_free_nodes(cssg_node *e) {
     case CSSG_NODE_HTML_INLINE:
     case CSSG_NODE_CODE:
     case CSSG_NODE_HTML_BLOCK:
-      mem->free(e->data);
+      cssg_node_free_data(e);
       break;
     case CSSG_NODE_LINK:
     case CSSG_NODE_IMAGE:
@@ -127,6 +137,10 @@ static void S_free_nodes(cssg_node *e) {
       mem->free(e->as.custom.on_enter);
       mem->free(e->as.custom.on_exit);
       break;
+    case CSSG_NODE_DOCUMENT:
+      if (e->as.document.front_matter)
+        toml_free(e->as.document.front_matter);
+      break;
     default:
       break;
     }
@@ -147,6 +161,22 @@ void cssg_node_free(cssg_node *node) {
   S_free_nodes(node);
 }
 
+bufsize_t cssg_node_estimate_output(cssg_node *root, bufsize_t per_block,
+                                    bufsize_t per_inline) {
+  const cssg_document *doc;
+  int64_t size;
+
+  if (root == NULL || root->type != CSSG_NODE_DOCUMENT)
+    return 0;
+
+  // Allow a little extra for escaping in text and more in URLs.
+  doc = &root->as.document;
+  size = (int64_t)doc->text_bytes + doc->text_bytes / 16 + doc->url_bytes +
+         doc->url_bytes / 4 + (int64_t)doc->blocks * per_block +
+         (int64_t)doc->inlines * per_inline;
+  return size > INT32_MAX / 4 ? INT32_MAX / 4 : (bufsize_t)size;
+}
+
 cssg_node_type cssg_node_get_type(cssg_node *node) {
   if (node == NULL) {
     return CSSG_NODE_NONE;
@@ -315,7 +345,12 @@ int cssg_node_set_literal(cssg_node *node, const char *content) {
   case CSSG_NODE_HTML_INLINE:
   case CSSG_NODE_CODE:
   case CSSG_NODE_CODE_BLOCK:
+    if (node->flags & CSSG_NODE__INLINE_DATA) {
+      node->flags &= ~CSSG_NODE__INLINE_DATA;
+      node->data = NULL;
+    }
     node->len = cssg_set_cstr(node->mem, &node->data, content);
+    S_node_changed(node);
     return 1;
 
   default:
@@ -349,6 +384,7 @@ int cssg_node_set_heading_level(cssg_node *node, int level) {
   switch (node->type) {
   case CSSG_NODE_HEADING:
     node->as.heading.level = level;
+    S_node_changed(node);
     return 1;
 
   default:
@@ -381,6 +417,7 @@ int cssg_node_set_list_type(cssg_node *node, cssg_list_type type) {
 
   if (node->type == CSSG_NODE_LIST) {
     node->as.list.list_type = (unsigned char)type;
+    S_node_changed(node);
     return 1;
   } else {
     return 0;
@@ -410,6 +447,7 @@ int cssg_node_set_list_delim(cssg_node *node, cssg_delim_type delim) {
 
   if (node->type == CSSG_NODE_LIST) {
     node->as.list.delimiter = (unsigned char)delim;
+    S_node_changed(node);
     return 1;
   } else {
     return 0;
@@ -435,6 +473,7 @@ int cssg_node_set_list_start(cssg_node *node, int start) {
 
   if (node->type == CSSG_NODE_LIST) {
     node->as.list.start = start;
+    S_node_changed(node);
     return 1;
   } else {
     return 0;
@@ -460,6 +499,7 @@ int cssg_node_set_list_tight(cssg_node *node, int tight) {
 
   if (node->type == CSSG_NODE_LIST) {
     node->as.list.tight = tight == 1;
+    S_node_changed(node);
     return 1;
   } else {
     return 0;
@@ -485,6 +525,7 @@ int cssg_node_set_fence_info(cssg_node *node, const char *info) {
 
   if (node->type == CSSG_NODE_CODE_BLOCK) {
     cssg_set_cstr(node->mem, &node->as.code.info, info);
+    S_node_changed(node);
     return 1;
   } else {
     return 0;
@@ -516,6 +557,7 @@ int cssg_node_set_url(cssg_node *node, const char *url) {
   case CSSG_NODE_LINK:
   case CSSG_NODE_IMAGE:
     cssg_set_cstr(node->mem, &node->as.link.url, url);
+    S_node_changed(node);
     return 1;
   default:
     break;
@@ -549,6 +591,7 @@ int cssg_node_set_title(cssg_node *node, const char *title) {
   case CSSG_NODE_LINK:
   case CSSG_NODE_IMAGE:
     cssg_set_cstr(node->mem, &node->as.link.title, title);
+    S_node_changed(node);
     return 1;
   default:
     break;
@@ -582,6 +625,7 @@ int cssg_node_set_on_enter(cssg_node *node, const char *on_enter) {
   case CSSG_NODE_CUSTOM_INLINE:
   case CSSG_NODE_CUSTOM_BLOCK:
     cssg_set_cstr(node->mem, &node->as.custom.on_enter, on_enter);
+    S_node_changed(node);
     return 1;
   default:
     break;
@@ -615,6 +659,7 @@ int cssg_node_set_on_exit(cssg_node *node, const char *on_exit) {
   case CSSG_NODE_CUSTOM_INLINE:
   case CSSG_NODE_CUSTOM_BLOCK:
     cssg_set_cstr(node->mem, &node->as.custom.on_exit, on_exit);
+    S_node_changed(node);
     return 1;
   default:
     break;
@@ -651,6 +696,14 @@ int cssg_node_get_end_column(cssg_node *node) {
   return node->end_column;
 }
 
+toml_table_t *cssg_node_get_front_matter(cssg_node *node) {
+  if (node == NULL || node->type != CSSG_NODE_DOCUMENT) {
+    return NULL;
+  }
+
+  return node->as.document.front_matter;
+}
+
 // Unlink a node without adjusting its next, prev, and parent pointers.
 static void S_node_unlink(cssg_node *node) {
   if (node == NULL) {
@@ -667,6 +720,7 @@ static void S_node_unlink(cssg_node *node) {
   // Adjust first_child and last_child of parent.
   cssg_node *parent = node->parent;
   if (parent) {
+    S_node_changed(parent);
     if (parent->first_child == node) {
       parent->first_child = node->next;
     }
@@ -708,6 +762,7 @@ int cssg_node_insert_before(cssg_node *node, cssg_node *sibling) {
   // Set new parent.
   cssg_node *parent = node->parent;
   sibling->parent = parent;
+  S_node_changed(parent);
 
   // Adjust first_child of parent if inserted as first child.
   if (parent && !old_prev) {
@@ -741,6 +796,7 @@ int cssg_node_insert_after(cssg_node *node, cssg_node *sibling) {
   // Set new parent.
   cssg_node *parent = node->parent;
   sibling->parent = parent;
+  S_node_changed(parent);
 
   // Adjust last_child of parent if inserted as last child.
   if (parent && !old_next) {
@@ -771,6 +827,7 @@ int cssg_node_prepend_child(cssg_node *node, cssg_node *child) {
   child->prev = NULL;
   child->parent = node;
   node->first_child = child;
+  S_node_changed(node);
 
   if (old_first_child) {
     old_first_child->prev = child;
@@ -795,6 +852,7 @@ int cssg_node_append_child(cssg_node *node, cssg_node *child) {
   child->prev = old_last_child;
   child->parent = node;
   node->last_child = child;
+  S_node_changed(node);
 
   if (old_last_child) {
     old_last_child->next = child;
@@ -806,6 +864,120 @@ int cssg_node_append_child(cssg_node *node, cssg_node *child) {
   return 1;
 }
 
+// Forget the content hash of every top-level block containing 'node'.
+static void S_node_changed(cssg_node *node) {
+  for (; node != NULL; node = node->parent) {
+    if (node->flags & CSSG_NODE__BLOCK_HASH)
+      node->block_hash = 0;
+  }
+}
+
+#define HASH_PRIME 1099511628211ULL
+
+// FNV-style, but a word at a time: block text is most of what is hashed.
+static uint64_t S_hash_bytes(uint64_t h, const unsigned char *data,
+                             size_t len) {
+  uint64_t word;
+
+  while (len >= 8) {
+    memcpy(&word, data, 8);
+    h = (h ^ word) * HASH_PRIME;
+    h ^= h >> 29;
+    data += 8;
+    len -= 8;
+  }
+  while (len > 0) {
+    h = (h ^ *data++) * HASH_PRIME;
+    len--;
+  }
+  return h;
+}
+
+static void S_key_int(cssg_strbuf *key, int64_t value) {
+  cssg_strbuf_put(key, (const unsigned char *)&value, sizeof(value));
+}
+
+// Appends a NUL-terminated attribute, telling NULL apart from "".
+static void S_key_cstr(cssg_strbuf *key, const unsigned char *str) {
+  if (str == NULL) {
+    S_key_int(key, -1);
+    return;
+  }
+  S_key_int(key, (int64_t)strlen((const char *)str));
+  cssg_strbuf_puts(key, (const char *)str);
+}
+
+uint64_t cssg_node_block_key(cssg_node *node, cssg_strbuf *key) {
+  bufsize_t start = key->size;
+  cssg_node *cur = node;
+  int base;
+  int depth = 0;
+  uint64_t h;
+
+  if (node == NULL || !(node->flags & CSSG_NODE__BLOCK_HASH))
+    return 0;
+
+  base = node->start_line;
+  while (cur != NULL) {
+    S_key_int(key, depth);
+    S_key_int(key, cur->type);
+    S_key_int(key, cur->start_line - base);
+    S_key_int(key, cur->start_column);
+    S_key_int(key, cur->end_line - base);
+    S_key_int(key, cur->end_column);
+    S_key_int(key, cur->len);
+    cssg_strbuf_put(key, cur->data, cur->len);
+
+    switch (cur->type) {
+    case CSSG_NODE_LIST:
+      S_key_int(key, cur->as.list.list_type);
+      S_key_int(key, cur->as.list.delimiter);
+      S_key_int(key, cur->as.list.start);
+      S_key_int(key, cur->as.list.bullet_char);
+      S_key_int(key, cur->as.list.tight);
+      break;
+    case CSSG_NODE_CODE_BLOCK:
+      S_key_cstr(key, cur->as.code.info);
+      break;
+    case CSSG_NODE_HEADING:
+      S_key_int(key, cur->as.heading.level);
+      break;
+    case CSSG_NODE_LINK:
+    case CSSG_NODE_IMAGE:
+      S_key_cstr(key, cur->as.link.url);
+      S_key_cstr(key, cur->as.link.title);
+      break;
+    case CSSG_NODE_CUSTOM_BLOCK:
+    case CSSG_NODE_CUSTOM_INLINE:
+      S_key_cstr(key, cur->as.custom.on_enter);
+      S_key_cstr(key, cur->as.custom.on_exit);
+      break;
+    default:
+      break;
+    }
+
+    // Depth-first, without leaving the subtree of 'node'.
+    if (cur->first_child) {
+      cur = cur->first_child;
+      depth++;
+      continue;
+    }
+    while (cur != node && cur->next == NULL) {
+      cur = cur->parent;
+      depth--;
+    }
+    cur = cur == node ? NULL : cur->next;
+  }
+
+  if (node->block_hash != 0)
+    return node->block_hash;
+  h = S_hash_bytes(14695981039346656037ULL, key->ptr + start,
+                   (size_t)(key->size - start));
+  // 0 means "not computed yet".
+  node->block_hash = h ? h : 1;
+  return node->block_hash;
+}
+
 static void S_print_error(FILE *out, cssg_node *node, const char *elem) {
   if (out == NULL) {
     return;
@@ -11,6 +11,7 @@ extern "C" {
 
 #include "cssg.h"
 #include "buffer.h"
+#include "toml.h"
 
 typedef struct {
   int marker_offset;
@@ -46,31 +47,36 @@ typedef struct {
   unsigned char *on_exit;
 } cssg_custom;
 
+// Size statistics gathered while parsing, used by the renderers to size
+// their output buffer up front.  Only valid on a parsed document node.
+typedef struct {
+  bufsize_t text_bytes; // literal content of leaf nodes
+  bufsize_t url_bytes;  // link and image URLs and titles
+  int32_t blocks;
+  int32_t inlines;
+  toml_table_t *front_matter; // see CSSG_OPT_FRONT_MATTER, or NULL
+} cssg_document;
+
 enum cssg_node__internal_flags {
   CSSG_NODE__OPEN = (1 << 0),
   CSSG_NODE__LAST_LINE_BLANK = (1 << 1),
   CSSG_NODE__LAST_LINE_CHECKED = (1 << 2),
   CSSG_NODE__LIST_LAST_LINE_BLANK = (1 << 3),
+  // 'data' points just past the node in the same allocation.
+  CSSG_NODE__INLINE_DATA = (1 << 4),
+  // 'block_hash' is in use (top-level blocks only).
+  CSSG_NODE__BLOCK_HASH = (1 << 5),
 };
 
 struct cssg_node {
-  cssg_mem *mem;
-
+  // Everything an iterator or renderer reads on each step comes first,
+  // so a traversal touches one cache line per node.
   struct cssg_node *next;
-  struct cssg_node *prev;
   struct cssg_node *parent;
   struct cssg_node *first_child;
-  struct cssg_node *last_child;
-
-  void *user_data;
 
   unsigned char *data;
   bufsize_t len;
-
-  int start_line;
-  int start_column;
-  int end_line;
-  int end_column;
   uint16_t type;
   uint16_t flags;
 
@@ -80,12 +86,51 @@ struct cssg_node {
     cssg_heading heading;
     cssg_link link;
     cssg_custom custom;
+    cssg_document document;
     int html_block_type;
   } as;
+
+  struct cssg_node *prev;
+  struct cssg_node *last_child;
+
+  cssg_mem *mem;
+  void *user_data;
+
+  int start_line;
+  int start_column;
+  int end_line;
+  int end_column;
+
+  // Content hash of a top-level block, or 0 until it is computed; see
+  // cssg_node_block_key().
+  uint64_t block_hash;
 };
 
 CSSG_EXPORT int cssg_node_check(cssg_node *node, FILE *out);
 
+/**
+ * Release 'node->data', which may share the node's allocation.
+ */
+void cssg_node_free_data(cssg_node *node);
+
+/**
+ * Estimate the size of rendering 'root', given the bytes a renderer
+ * emits for each block and inline node on top of their content.
+ * Returns 0 if 'root' carries no statistics.
+ */
+bufsize_t cssg_node_estimate_output(cssg_node *root, bufsize_t per_block,
+                                    bufsize_t per_inline);
+
+/**
+ * Append to 'key' everything that affects how top-level block 'node'
+ * renders: its subtree's types, attributes and content, and source
+ * positions relative to its first line.  Blocks with equal keys render
+ * the same.  Returns a hash of the key, which is kept until the subtree
+ * is changed through the node API, or 0, appending nothing, for nodes
+ * that carry no key.
+ */
+uint64_t cssg_node_block_key(cssg_node *node, cssg_strbuf *key);
+
 #ifdef __cplusplus
 }
 #endif
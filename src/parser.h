@@ -5,6 +5,7 @@
 #include "references.h"
 #include "node.h"
 #include "buffer.h"
+#include "chunk.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -27,12 +28,17 @@ struct cssg_parser {
   bool blank;
   bool partially_consumed_tab;
   cssg_strbuf curline;
+  // The line being processed; points into curline or, for lines that
+  // need no repair, directly into the buffer passed to the parser.
+  cssg_chunk line;
   bufsize_t last_line_length;
   cssg_strbuf linebuf;
   cssg_strbuf content;
   int options;
   bool last_buffer_ended_with_cr;
   unsigned int total_size;
+  int front_matter; // FRONT_MATTER_* state
+  cssg_strbuf front_matter_lines; // lines of an open front matter block
 };
 
 #ifdef __cplusplus
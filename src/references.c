@@ -1,9 +1,13 @@
+#include <errno.h>
+#include <stdlib.h>
+
 #include "cssg.h"
 #include "utf8.h"
 #include "parser.h"
 #include "references.h"
 #include "inlines.h"
 #include "chunk.h"
+#include "toml.h"
 
 static void reference_free(cssg_reference_map *map, cssg_reference *ref) {
   cssg_mem *mem = map->mem;
@@ -15,128 +19,155 @@ static void reference_free(cssg_reference_map *map, cssg_reference *ref) {
   }
 }
 
-// normalize reference:  collapse internal whitespace to single space,
-// remove leading/trailing whitespace, case fold
-// Return NULL if the reference name is actually empty (i.e. composed
-// solely from whitespace)
-static unsigned char *normalize_reference(cssg_mem *mem, cssg_chunk *ref) {
-  cssg_strbuf normalized = CSSG_BUF_INIT(mem);
-  unsigned char *result;
+#define REFMAP_MIN_CAPACITY 8
 
-  if (ref == NULL)
-    return NULL;
+// normalize reference into 'buf':  collapse internal whitespace to
+// single space, remove leading/trailing whitespace, case fold
+// Return false if the reference name is actually empty (i.e. composed
+// solely from whitespace)
+static bool normalize_reference(cssg_strbuf *buf, cssg_chunk *ref) {
+  if (ref == NULL || ref->len == 0)
+    return false;
+
+  // Fold straight into the scratch buffer; it is sized for the worst
+  // case once and reused for every label.
+  cssg_strbuf_clear(buf);
+  cssg_strbuf_grow(buf, CSSG_CASE_FOLD_MAX_GROWTH * ref->len);
+  buf->size = cssg_utf8proc_case_fold_into(buf->ptr, ref->data, ref->len);
+  buf->ptr[buf->size] = '\0';
+  cssg_strbuf_trim(buf);
+  cssg_strbuf_normalize_whitespace(buf);
+
+  return buf->size > 0;
+}
 
-  if (ref->len == 0)
-    return NULL;
+// FNV-1a
+static uint32_t label_hash(const unsigned char *label, bufsize_t len) {
+  uint32_t h = 2166136261u;
+  bufsize_t i;
 
-  cssg_utf8proc_case_fold(&normalized, ref->data, ref->len);
-  cssg_strbuf_trim(&normalized);
-  cssg_strbuf_normalize_whitespace(&normalized);
+  for (i = 0; i < len; i++) {
+    h ^= label[i];
+    h *= 16777619u;
+  }
+  return h;
+}
 
-  result = cssg_strbuf_detach(&normalized);
-  assert(result);
+// Returns the slot holding 'label', or the empty slot where it belongs.
+static cssg_reference **find_slot(cssg_reference_map *map,
+                                  const unsigned char *label, uint32_t hash) {
+  unsigned int mask = map->capacity - 1;
+  unsigned int i = hash & mask;
+  cssg_reference *ref;
 
-  if (result[0] == '\0') {
-    mem->free(result);
-    return NULL;
+  while ((ref = map->table[i]) != NULL) {
+    if (ref->hash == hash &&
+        strcmp((const char *)ref->label, (const char *)label) == 0)
+      break;
+    i = (i + 1) & mask;
   }
+  return &map->table[i];
+}
 
-  return result;
+static void grow_table(cssg_reference_map *map) {
+  cssg_reference **old = map->table;
+  unsigned int old_capacity = map->capacity;
+  unsigned int i;
+
+  map->capacity = old_capacity ? old_capacity * 2 : REFMAP_MIN_CAPACITY;
+  map->table = (cssg_reference **)map->mem->calloc(map->capacity,
+                                                    sizeof(cssg_reference *));
+  for (i = 0; i < old_capacity; i++) {
+    cssg_reference *ref = old[i];
+    if (ref != NULL) {
+      unsigned int mask = map->capacity - 1;
+      unsigned int j = ref->hash & mask;
+      while (map->table[j] != NULL)
+        j = (j + 1) & mask;
+      map->table[j] = ref;
+    }
+  }
+  map->mem->free(old);
 }
 
-void cssg_reference_create(cssg_reference_map *map, cssg_chunk *label,
-                            cssg_chunk *url, cssg_chunk *title) {
+// Adds an entry for 'label' and returns it with no URL or title, or
+// returns NULL if the label is empty or already defined.
+static cssg_reference *insert_reference(cssg_reference_map *map,
+                                        cssg_chunk *label) {
   cssg_reference *ref;
-  unsigned char *reflabel = normalize_reference(map->mem, label);
+  cssg_reference **slot;
+  uint32_t hash;
 
   /* empty reference name, or composed from only whitespace */
-  if (reflabel == NULL)
-    return;
+  if (!normalize_reference(&map->scratch, label))
+    return NULL;
 
-  assert(map->sorted == NULL);
+  // Keep the table at most half full.
+  if ((map->size + 1) * 2 > map->capacity)
+    grow_table(map);
+
+  hash = label_hash(map->scratch.ptr, map->scratch.size);
+  slot = find_slot(map, map->scratch.ptr, hash);
+
+  /* the first definition of a label wins */
+  if (*slot != NULL)
+    return NULL;
 
   ref = (cssg_reference *)map->mem->calloc(1, sizeof(*ref));
-  ref->label = reflabel;
-  ref->url = cssg_clean_url(map->mem, url);
-  ref->title = cssg_clean_title(map->mem, title);
-  ref->age = map->size;
-  ref->next = map->refs;
+  ref->label = (unsigned char *)map->mem->calloc(map->scratch.size + 1, 1);
+  memcpy(ref->label, map->scratch.ptr, map->scratch.size);
+  ref->hash = hash;
 
+  *slot = ref;
+  map->size++;
+  return ref;
+}
+
+static void set_reference_size(cssg_reference *ref) {
   if (ref->url != NULL)
     ref->size += (int)strlen((char*)ref->url);
   if (ref->title != NULL)
     ref->size += (int)strlen((char*)ref->title);
-
-  map->refs = ref;
-  map->size++;
-}
-
-static int
-labelcmp(const unsigned char *a, const unsigned char *b) {
-  return strcmp((const char *)a, (const char *)b);
-}
-
-static int
-refcmp(const void *p1, const void *p2) {
-  cssg_reference *r1 = *(cssg_reference **)p1;
-  cssg_reference *r2 = *(cssg_reference **)p2;
-  int res = labelcmp(r1->label, r2->label);
-  return res ? res : ((int)r1->age - (int)r2->age);
-}
-
-static int
-refsearch(const void *label, const void *p2) {
-  cssg_reference *ref = *(cssg_reference **)p2;
-  return labelcmp((const unsigned char *)label, ref->label);
 }
 
-static void sort_references(cssg_reference_map *map) {
-  unsigned int i = 0, last = 0, size = map->size;
-  cssg_reference *r = map->refs, **sorted = NULL;
-
-  sorted = (cssg_reference **)map->mem->calloc(size, sizeof(cssg_reference *));
-  while (r) {
-    sorted[i++] = r;
-    r = r->next;
-  }
+void cssg_reference_create(cssg_reference_map *map, cssg_chunk *label,
+                            cssg_chunk *url, cssg_chunk *title) {
+  cssg_reference *ref = insert_reference(map, label);
 
-  qsort(sorted, size, sizeof(cssg_reference *), refcmp);
+  if (ref == NULL)
+    return;
 
-  for (i = 1; i < size; i++) {
-    if (labelcmp(sorted[i]->label, sorted[last]->label) != 0)
-      sorted[++last] = sorted[i];
-  }
-  map->sorted = sorted;
-  map->size = last + 1;
+  ref->url = cssg_clean_url(map->mem, url);
+  ref->title = cssg_clean_title(map->mem, title);
+  set_reference_size(ref);
 }
 
-// Returns reference if refmap contains a reference with matching
-// label, otherwise NULL.
+// Returns reference if refmap, or the shared map attached to it,
+// contains a reference with matching label, otherwise NULL.
 cssg_reference *cssg_reference_lookup(cssg_reference_map *map,
                                         cssg_chunk *label) {
-  cssg_reference **ref = NULL;
   cssg_reference *r = NULL;
-  unsigned char *norm;
+  uint32_t hash;
 
   if (label->len < 1 || label->len > MAX_LINK_LABEL_LENGTH)
     return NULL;
 
-  if (map == NULL || !map->size)
+  if (map == NULL || (!map->size && !map->shared))
     return NULL;
 
-  norm = normalize_reference(map->mem, label);
-  if (norm == NULL)
+  if (!normalize_reference(&map->scratch, label))
     return NULL;
 
-  if (!map->sorted)
-    sort_references(map);
+  hash = label_hash(map->scratch.ptr, map->scratch.size);
+  if (map->size)
+    r = *find_slot(map, map->scratch.ptr, hash);
 
-  ref = (cssg_reference **)bsearch(norm, map->sorted, map->size, sizeof(cssg_reference *),
-                refsearch);
-  map->mem->free(norm);
+  // The shared map is only read, never normalized into, so it can be
+  // attached to parsers on several threads at once.
+  if (r == NULL && map->shared && map->shared->size)
+    r = *find_slot((cssg_reference_map *)map->shared, map->scratch.ptr, hash);
 
-  if (ref != NULL) {
-    r = ref[0];
+  if (r != NULL) {
     /* Check for expansion limit */
     if (map->max_ref_size && r->size > map->max_ref_size - map->ref_size)
       return NULL;
@@ -147,19 +178,16 @@ cssg_reference *cssg_reference_lookup(cssg_reference_map *map,
 }
 
 void cssg_reference_map_free(cssg_reference_map *map) {
-  cssg_reference *ref;
+  unsigned int i;
 
   if (map == NULL)
     return;
 
-  ref = map->refs;
-  while (ref) {
-    cssg_reference *next = ref->next;
-    reference_free(map, ref);
-    ref = next;
-  }
+  for (i = 0; i < map->capacity; i++)
+    reference_free(map, map->table[i]);
 
-  map->mem->free(map->sorted);
+  map->mem->free(map->table);
+  cssg_strbuf_free(&map->scratch);
   map->mem->free(map);
 }
 
@@ -167,5 +195,105 @@ cssg_reference_map *cssg_reference_map_new(cssg_mem *mem) {
   cssg_reference_map *map =
       (cssg_reference_map *)mem->calloc(1, sizeof(cssg_reference_map));
   map->mem = mem;
+  cssg_strbuf_init(mem, &map->scratch, 0);
   return map;
 }
+
+static unsigned char *copy_string(cssg_mem *mem, const char *s) {
+  size_t len = strlen(s);
+  unsigned char *copy = (unsigned char *)mem->calloc(len + 1, 1);
+  memcpy(copy, s, len);
+  return copy;
+}
+
+// Entries are either `label = "url"` or `label = { url = "...",
+// title = "..." }`.  Values are taken literally, without the backslash
+// and entity unescaping applied to Markdown definitions.
+static cssg_reference_map *load_toml(const char *path, cssg_mem *mem) {
+  char errbuf[200];
+  cssg_reference_map *map;
+  toml_table_t *conf;
+  const char *key;
+  FILE *fp;
+  int i;
+
+  fp = fopen(path, "rb");
+  if (fp == NULL)
+    return NULL;
+  conf = toml_parse_file_inplace(fp, errbuf, sizeof(errbuf));
+  fclose(fp);
+  if (conf == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  map = cssg_reference_map_new(mem);
+  for (i = 0; (key = toml_key_in(conf, i)) != NULL; i++) {
+    cssg_chunk label = {(const unsigned char *)key, (bufsize_t)strlen(key)};
+    toml_table_t *entry = toml_table_in(conf, key);
+    toml_datum_t url, title;
+    cssg_reference *ref;
+
+    title.ok = 0;
+    if (entry != NULL) {
+      url = toml_string_in(entry, "url");
+      title = toml_string_in(entry, "title");
+    } else {
+      url = toml_string_in(conf, key);
+    }
+
+    if (url.ok && (ref = insert_reference(map, &label)) != NULL) {
+      ref->url = copy_string(mem, url.u.s);
+      if (title.ok)
+        ref->title = copy_string(mem, title.u.s);
+      set_reference_size(ref);
+    }
+
+    if (url.ok)
+      free(url.u.s);
+    if (title.ok)
+      free(title.u.s);
+  }
+
+  toml_free(conf);
+  return map;
+}
+
+// Parses the file as Markdown and keeps only its link reference
+// definitions.
+static cssg_reference_map *load_markdown(const char *path, int options,
+                                         cssg_mem *mem) {
+  cssg_reference_map *map;
+  cssg_parser *parser;
+  cssg_input input;
+
+  if (cssg_input_open(&input, path) != 0)
+    return NULL;
+
+  parser = cssg_parser_new_with_mem(options, mem);
+  cssg_parser_feed(parser, input.data, input.len);
+  cssg_node_free(cssg_parser_finish(parser));
+  cssg_input_close(&input);
+
+  map = parser->refmap;
+  parser->refmap = cssg_reference_map_new(mem);
+  cssg_parser_free(parser);
+
+  map->ref_size = 0;
+  map->max_ref_size = 0;
+  return map;
+}
+
+cssg_reference_map *cssg_reference_map_load(const char *path, int options) {
+  cssg_mem *mem = cssg_get_default_mem_allocator();
+  size_t len = strlen(path);
+
+  if (len > 5 && strcmp(path + len - 5, ".toml") == 0)
+    return load_toml(path, mem);
+  return load_markdown(path, options, mem);
+}
+
+void cssg_parser_set_shared_references(cssg_parser *parser,
+                                       const cssg_reference_map *shared) {
+  parser->refmap->shared = shared;
+}
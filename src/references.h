@@ -1,6 +1,9 @@
 #ifndef CSSG_REFERENCES_H
 #define CSSG_REFERENCES_H
 
+#include <stdint.h>
+
+#include "buffer.h"
 #include "chunk.h"
 
 #ifdef __cplusplus
@@ -8,27 +11,28 @@ extern "C" {
 #endif
 
 struct cssg_reference {
-  struct cssg_reference *next;
   unsigned char *label;
   unsigned char *url;
   unsigned char *title;
-  unsigned int age;
+  uint32_t hash;
   unsigned int size;
 };
 
 typedef struct cssg_reference cssg_reference;
 
+// Open-addressing hash table of references keyed on the normalized
+// label.  Lookups and inserts may be interleaved freely.
 struct cssg_reference_map {
   cssg_mem *mem;
-  cssg_reference *refs;
-  cssg_reference **sorted;
+  cssg_reference **table; // 'capacity' slots, NULL when empty
+  unsigned int capacity;  // zero or a power of two
   unsigned int size;
   unsigned int ref_size;
   unsigned int max_ref_size;
+  cssg_strbuf scratch; // normalized label of the current lookup
+  const cssg_reference_map *shared; // read-only fallback, or NULL
 };
 
-typedef struct cssg_reference_map cssg_reference_map;
-
 cssg_reference_map *cssg_reference_map_new(cssg_mem *mem);
 void cssg_reference_map_free(cssg_reference_map *map);
 cssg_reference *cssg_reference_lookup(cssg_reference_map *map,
@@ -4,6 +4,7 @@
 #include "utf8.h"
 #include "render.h"
 #include "node.h"
+#include "iterator.h"
 #include "cssg_ctype.h"
 
 static inline void S_cr(cssg_renderer *renderer) {
@@ -160,7 +161,7 @@ char *cssg_render(cssg_node *root, int options, int width,
   cssg_node *cur;
   cssg_event_type ev_type;
   char *result;
-  cssg_iter *iter = cssg_iter_new(root);
+  cssg_iter iter;
 
   cssg_renderer renderer = {options,
                              mem,    &buf,    &pref,      0,      width,
@@ -168,13 +169,16 @@ char *cssg_render(cssg_node *root, int options, int width,
                              false,  NULL,
                              outc,   S_cr,    S_blankline, S_out};
 
-  while ((ev_type = cssg_iter_next(iter)) != CSSG_EVENT_DONE) {
-    cur = cssg_iter_get_node(iter);
+  cssg_strbuf_reserve(&buf, cssg_node_estimate_output(root, 4, 2));
+  cssg_iter_init(&iter, root);
+
+  while ((ev_type = cssg_iter_step(&iter)) != CSSG_EVENT_DONE) {
+    cur = iter.cur.node;
     if (!render_node(&renderer, cur, ev_type, options)) {
       // a false value causes us to skip processing
       // the node's contents.  this is used for
       // autolinks.
-      cssg_iter_reset(iter, cur, CSSG_EVENT_EXIT);
+      cssg_iter_reset(&iter, cur, CSSG_EVENT_EXIT);
     }
   }
 
@@ -185,7 +189,6 @@ char *cssg_render(cssg_node *root, int options, int width,
 
   result = (char *)cssg_strbuf_detach(renderer.buffer);
 
-  cssg_iter_free(iter);
   cssg_strbuf_free(renderer.prefix);
   cssg_strbuf_free(renderer.buffer);
 
@@ -0,0 +1,133 @@
+#include <stdint.h>
+
+#include "simd.h"
+
+// Vector kernels are compiled with per-function target attributes and
+// selected at runtime, so the library itself still builds for the
+// baseline ISA.  Define CSSG_NO_SIMD to build only the scalar code.
+#if !defined(CSSG_NO_SIMD) && (defined(__x86_64__) || defined(__i386__)) &&  \
+    (defined(__GNUC__) || defined(__clang__))
+#define CSSG_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+static bufsize_t find_scalar(const cssg_byteset *set,
+                             const unsigned char *data, bufsize_t len) {
+  bufsize_t i;
+
+  for (i = 0; i < len; i++) {
+    if (set->lo[data[i] & 0x0F] & set->hi[data[i] >> 4])
+      return i;
+  }
+  return len;
+}
+
+#ifdef CSSG_SIMD_X86
+
+// For each byte, look its low and high nibbles up in the set's tables
+// and AND the results; a nonzero byte marks a member.  pshufb yields 0
+// for bytes with the top bit set, so non-ASCII bytes never match.
+__attribute__((target("ssse3"))) static bufsize_t
+find_ssse3(const cssg_byteset *set, const unsigned char *data,
+           bufsize_t len) {
+  const __m128i lo = _mm_loadu_si128((const __m128i *)set->lo);
+  const __m128i hi = _mm_loadu_si128((const __m128i *)set->hi);
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i zero = _mm_setzero_si128();
+  bufsize_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+    __m128i l = _mm_shuffle_epi8(lo, v);
+    __m128i h =
+        _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble));
+    unsigned mask = (unsigned)_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(_mm_and_si128(l, h), zero)) ^
+                    0xFFFF;
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+  return i + find_scalar(set, data + i, len - i);
+}
+
+__attribute__((target("avx2"))) static bufsize_t
+find_avx2(const cssg_byteset *set, const unsigned char *data,
+          bufsize_t len) {
+  const __m256i lo =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->lo));
+  const __m256i hi =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)set->hi));
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i zero = _mm256_setzero_si256();
+  bufsize_t i = 0;
+
+  for (; i + 32 <= len; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+    __m256i l = _mm256_shuffle_epi8(lo, v);
+    __m256i h = _mm256_shuffle_epi8(
+        hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble));
+    unsigned mask = ~(unsigned)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(_mm256_and_si256(l, h), zero));
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+  // Finish the tail here rather than in the SSSE3 kernel: switching to
+  // legacy SSE code with dirty upper YMM state costs more than it saves.
+  return i + find_scalar(set, data + i, len - i);
+}
+
+#endif
+
+bufsize_t cssg_byteset_find(const cssg_byteset *set,
+                            const unsigned char *data, bufsize_t len) {
+#ifdef CSSG_SIMD_X86
+  if (len >= 32 && __builtin_cpu_supports("avx2"))
+    return find_avx2(set, data, len);
+  if (len >= 16 && __builtin_cpu_supports("ssse3"))
+    return find_ssse3(set, data, len);
+#endif
+  return find_scalar(set, data, len);
+}
+
+static bufsize_t lower_scalar(unsigned char *dst, const unsigned char *src,
+                              bufsize_t len) {
+  bufsize_t i;
+
+  for (i = 0; i < len && src[i] < 0x80; i++)
+    dst[i] = src[i] >= 'A' && src[i] <= 'Z' ? src[i] + ('a' - 'A') : src[i];
+  return i;
+}
+
+#ifdef CSSG_SIMD_X86
+
+// Signed compares find 'A'-'Z'; bytes with the top bit set are negative,
+// so they fail the range test and stop the run via movemask.
+__attribute__((target("sse2"))) static bufsize_t
+lower_sse2(unsigned char *dst, const unsigned char *src, bufsize_t len) {
+  const __m128i before_a = _mm_set1_epi8('A' - 1);
+  const __m128i after_z = _mm_set1_epi8('Z' + 1);
+  const __m128i delta = _mm_set1_epi8('a' - 'A');
+  bufsize_t i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, before_a),
+                                  _mm_cmplt_epi8(v, after_z));
+    if (_mm_movemask_epi8(v))
+      break;
+    _mm_storeu_si128((__m128i *)(dst + i),
+                     _mm_add_epi8(v, _mm_and_si128(upper, delta)));
+  }
+  return i + lower_scalar(dst + i, src + i, len - i);
+}
+
+#endif
+
+bufsize_t cssg_ascii_lower(unsigned char *dst, const unsigned char *src,
+                           bufsize_t len) {
+#ifdef CSSG_SIMD_X86
+  if (len >= 16 && __builtin_cpu_supports("sse2"))
+    return lower_sse2(dst, src, len);
+#endif
+  return lower_scalar(dst, src, len);
+}
@@ -0,0 +1,39 @@
+#ifndef CSSG_SIMD_H
+#define CSSG_SIMD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "buffer.h"
+
+/** A set of ASCII bytes, in the form used by the vector scanners:
+ * byte c is a member iff (lo[c & 0x0F] & hi[c >> 4]) != 0.
+ * Generate the tables with tools/make_byteset.py.
+ */
+typedef struct {
+  uint8_t lo[16];
+  uint8_t hi[16];
+} cssg_byteset;
+
+/** Returns the offset of the first byte in data[0, len) that is a
+ * member of set, or len if there is none.  Uses AVX2 or SSSE3 when the
+ * CPU supports them, and a table lookup otherwise.
+ */
+bufsize_t cssg_byteset_find(const cssg_byteset *set,
+                            const unsigned char *data, bufsize_t len);
+
+/** Copies the leading run of ASCII bytes in src[0, len) to dst,
+ * lowercasing 'A'-'Z', and returns its length.  dst must have room for
+ * len bytes.
+ */
+bufsize_t cssg_ascii_lower(unsigned char *dst, const unsigned char *src,
+                           bufsize_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
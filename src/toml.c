@@ -29,11 +29,17 @@
 #include <assert.h>
 #include <ctype.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+
+#if defined(_MSC_VER) && !defined(S_ISREG)
+#define S_ISREG(m) (((m) & _S_IFMT) == _S_IFREG)
+#endif
 
 static void *(*ppmalloc)(size_t) = malloc;
 static void (*ppfree)(void *) = free;
@@ -275,6 +281,87 @@ int toml_ucs_to_utf8(int64_t code, char buf[6]) {
   return -1;
 }
 
+/*
+ * Memory for a table parsed in place: blocks that everything is carved
+ * from and that are released together, and the source text if the table
+ * owns it. The arena itself lives in its first block.
+ */
+typedef struct arena_block_t arena_block_t;
+struct arena_block_t {
+  arena_block_t *prev;
+  size_t size; /* bytes after the header */
+  size_t used;
+};
+
+typedef struct toml_arena_t toml_arena_t;
+struct toml_arena_t {
+  arena_block_t *block; /* newest block */
+  char *source;         /* freed with the arena, or 0 */
+
+  /* allocator for the blocks, or 0 to use MALLOC and FREE */
+  void *(*xxcalloc)(size_t, size_t);
+  void (*xxfree)(void *);
+};
+
+#define ARENA_HEADER ALIGN8(sizeof(arena_block_t))
+#define ARENA_MIN 4096
+
+static void *arena_alloc(toml_arena_t *arena, size_t n) {
+  arena_block_t *b = arena->block;
+
+  n = ALIGN8(n);
+  if (!b || b->size - b->used < n) {
+    /* double the block size, so there are few blocks */
+    size_t size = b ? b->size * 2 : ARENA_MIN;
+    if (size < n)
+      size = n;
+    b = arena->xxcalloc ? arena->xxcalloc(1, ARENA_HEADER + size)
+                      : MALLOC(ARENA_HEADER + size);
+    if (!b)
+      return 0;
+    b->prev = arena->block;
+    b->size = size;
+    b->used = 0;
+    arena->block = b;
+  }
+
+  void *p = (char *)b + ARENA_HEADER + b->used;
+  b->used += n;
+  return p;
+}
+
+/* Create an arena whose first block has room for size bytes. Blocks
+ * come from xxcalloc and go back to xxfree if these are given.
+ */
+static toml_arena_t *arena_new(size_t size, void *(*xxcalloc)(size_t, size_t),
+                               void (*xxfree)(void *)) {
+  toml_arena_t tmp = {0, 0, xxcalloc, xxfree};
+  toml_arena_t *arena;
+
+  if (0 == (arena = arena_alloc(&tmp, sizeof(*arena) + size)))
+    return 0;
+  /* give back all but the arena itself */
+  tmp.block->used = ALIGN8(sizeof(*arena));
+  *arena = tmp;
+  return arena;
+}
+
+static void arena_free(toml_arena_t *arena) {
+  arena_block_t *b = arena->block;
+  char *source = arena->source;
+  void (*xxfree)(void *) = arena->xxcalloc ? arena->xxfree : ppfree;
+
+  /* the arena lives in its first block, so it is not touched again */
+  while (b) {
+    arena_block_t *prev = b->prev;
+    if (xxfree)
+      xxfree(b);
+    b = prev;
+  }
+  if (source)
+    FREE(source);
+}
+
 /*
  *  TOML has 3 data structures: value, array, table.
  *  Each of them can have identification key.
@@ -301,7 +388,10 @@ struct toml_array_t {
                       'D'ate, 'T'imestamp, 'm'ixed */
 
   int nitem; /* number of elements */
+  int itemcap; /* number of elements allocated */
   toml_arritem_t *item;
+
+  toml_value_t *value; /* nitem values from toml_decode(), or 0 */
 };
 
 struct toml_table_t {
@@ -311,17 +401,39 @@ struct toml_table_t {
 
   /* key-values in the table */
   int nkval;
+  int kvalcap;
   toml_keyval_t **kval;
 
   /* arrays in the table */
   int narr;
+  int arrcap;
   toml_array_t **arr;
 
   /* tables in the table */
   int ntab;
+  int tabcap;
   toml_table_t **tab;
+
+  /* hash index of all keys, built once there are more than
+   * TOML_INDEX_MIN. Each of the nindex slots is 0 or an entry made by
+   * INDEX_ENTRY(). */
+  int nindex;
+  int *index;
+
+  /* set in the root table of a parse in place */
+  toml_arena_t *arena;
+
+  /* nkval values from toml_decode(), or 0 */
+  toml_value_t *value;
 };
 
+#define TOML_INDEX_MIN 8
+
+#define INDEX_ENTRY(kind, pos) ((pos) << 2 | (kind))
+#define INDEX_KVAL 1
+#define INDEX_ARR 2
+#define INDEX_TAB 3
+
 static inline void xfree(const void *x) {
   if (x)
     FREE((void *)(intptr_t)x);
@@ -361,6 +473,9 @@ struct context_t {
   toml_table_t *root;
   toml_table_t *curtab;
 
+  /* for a parse in place; keys and values are then left in the source */
+  toml_arena_t *arena;
+
   struct {
     int top;
     char *key[10];
@@ -407,6 +522,58 @@ static int e_forbid(context_t *ctx, int lineno, const char *msg) {
   return -1;
 }
 
+/*
+ * Allocation while parsing, from the arena of a parse in place. Memory
+ * from an arena is not freed on its own.
+ */
+static void *ctx_malloc(context_t *ctx, size_t n) {
+  return ctx->arena ? arena_alloc(ctx->arena, n) : MALLOC(n);
+}
+
+static void *ctx_calloc(context_t *ctx, size_t nmemb, size_t sz) {
+  if (!ctx->arena)
+    return CALLOC(nmemb, sz);
+
+  void *p = arena_alloc(ctx->arena, nmemb * sz);
+  if (p)
+    memset(p, 0, nmemb * sz);
+  return p;
+}
+
+static void ctx_free(context_t *ctx, const void *p) {
+  if (!ctx->arena)
+    xfree(p);
+}
+
+static char *ctx_strndup(context_t *ctx, const char *s, size_t n) {
+  if (!ctx->arena)
+    return STRNDUP(s, n);
+
+  size_t len = strnlen(s, n);
+  char *p = arena_alloc(ctx->arena, len + 1);
+  if (p) {
+    memcpy(p, s, len);
+    p[len] = 0;
+  }
+  return p;
+}
+
+/*
+ * Return the n chars at s, which the scanner has moved past, as a NUL
+ * terminated string. A parse in place terminates them where they are,
+ * unless the NUL would land on the start of the current STRING token.
+ */
+static char *token_text(context_t *ctx, char *s, int n) {
+  char *end = s + n;
+
+  if (ctx->arena && (end < ctx->tok.ptr ||
+                     (end == ctx->tok.ptr && ctx->tok.tok != STRING))) {
+    *end = 0;
+    return s;
+  }
+  return ctx_strndup(ctx, s, n);
+}
+
 static void *expand(void *p, int sz, int newsz) {
   void *s = MALLOC(newsz);
   if (!s)
@@ -419,26 +586,42 @@ static void *expand(void *p, int sz, int newsz) {
   return s;
 }
 
-static void **expand_ptrarr(void **p, int n) {
-  void **s = MALLOC((n + 1) * sizeof(void *));
+/*
+ * Make room for element n of an array of n elements, *cap of them
+ * allocated, doubling the allocation when it is full. The elements past
+ * n are zeroed. Return the array, which may have moved, or 0 if out of
+ * memory.
+ */
+static void *expand_cap(context_t *ctx, void *p, int n, int *cap,
+                        int elemsz) {
+  if (n < *cap)
+    return p;
+
+  int newcap = *cap ? *cap * 2 : 4;
+  if (newcap > INT_MAX / elemsz)
+    return 0;
+
+  char *s = ctx_malloc(ctx, newcap * elemsz);
   if (!s)
     return 0;
 
-  s[n] = 0;
   if (p) {
-    memcpy(s, p, n * sizeof(void *));
-    FREE(p);
+    memcpy(s, p, n * elemsz);
+    ctx_free(ctx, p);
   }
+  memset(s + n * elemsz, 0, (newcap - n) * elemsz);
+  *cap = newcap;
   return s;
 }
 
-static toml_arritem_t *expand_arritem(toml_arritem_t *p, int n) {
-  toml_arritem_t *pp = expand(p, n * sizeof(*p), (n + 1) * sizeof(*p));
-  if (!pp)
-    return 0;
+static void **expand_ptrarr(context_t *ctx, void **p, int n, int *cap) {
+  /* keep a NULL after the last pointer */
+  return (void **)expand_cap(ctx, p, n + 1, cap, sizeof(void *));
+}
 
-  memset(&pp[n], 0, sizeof(pp[n]));
-  return pp;
+static toml_arritem_t *expand_arritem(context_t *ctx, toml_arritem_t *p,
+                                      int n, int *cap) {
+  return (toml_arritem_t *)expand_cap(ctx, p, n, cap, sizeof(*p));
 }
 
 static char *norm_lit_str(const char *src, int srclen, int multiline,
@@ -453,7 +636,7 @@ static char *norm_lit_str(const char *src, int srclen, int multiline,
   /* scan forward on src */
   for (;;) {
     if (off >= max - 10) { /* have some slack for misc stuff */
-      int newmax = max + 50;
+      int newmax = max ? max * 2 : 64;
       char *x = expand(dst, max, newmax);
       if (!x) {
         xfree(dst);
@@ -502,7 +685,7 @@ static char *norm_basic_str(const char *src, int srclen, int multiline,
   /* scan forward on src */
   for (;;) {
     if (off >= max - 10) { /* have some slack for misc stuff */
-      int newmax = max + 50;
+      int newmax = max ? max * 2 : 64;
       char *x = expand(dst, max, newmax);
       if (!x) {
         xfree(dst);
@@ -643,7 +826,7 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
 
     if (ch == '\'') {
       /* for single quote, take it verbatim. */
-      if (!(ret = STRNDUP(sp, sq - sp))) {
+      if (!(ret = ctx_strndup(ctx, sp, sq - sp))) {
         e_outofmemory(ctx, FLINE);
         return 0;
       }
@@ -654,11 +837,20 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
         e_syntax(ctx, lineno, ebuf);
         return 0;
       }
+      if (ctx->arena) {
+        char *tmp = ret;
+        ret = ctx_strndup(ctx, tmp, strlen(tmp));
+        xfree(tmp);
+        if (!ret) {
+          e_outofmemory(ctx, FLINE);
+          return 0;
+        }
+      }
     }
 
     /* newlines are not allowed in keys */
     if (strchr(ret, '\n')) {
-      xfree(ret);
+      ctx_free(ctx, ret);
       e_badkey(ctx, lineno);
       return 0;
     }
@@ -678,13 +870,111 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
   }
 
   /* dup and return it */
-  if (!(ret = STRNDUP(sp, sq - sp))) {
+  if (!(ret = token_text(ctx, strtok.ptr, strtok.len))) {
     e_outofmemory(ctx, FLINE);
     return 0;
   }
   return ret;
 }
 
+/* FNV-1a */
+static unsigned key_hash(const char *key) {
+  unsigned h = 2166136261u;
+  for (; *key; key++) {
+    h ^= (unsigned char)*key;
+    h *= 16777619u;
+  }
+  return h;
+}
+
+static const char *index_key(const toml_table_t *tab, int entry) {
+  int pos = entry >> 2;
+  switch (entry & 3) {
+  case INDEX_KVAL:
+    return tab->kval[pos]->key;
+  case INDEX_ARR:
+    return tab->arr[pos]->key;
+  default:
+    return tab->tab[pos]->key;
+  }
+}
+
+static void index_put(toml_table_t *tab, int entry) {
+  unsigned mask = (unsigned)tab->nindex - 1;
+  unsigned i = key_hash(index_key(tab, entry)) & mask;
+
+  while (tab->index[i])
+    i = (i + 1) & mask;
+  tab->index[i] = entry;
+}
+
+/*
+ * Add the entry just appended to tab to its index. The index is built
+ * when the table first has more than TOML_INDEX_MIN keys, and rebuilt
+ * twice as large whenever it would be more than half full.
+ * Return -1 if out of memory.
+ */
+static int index_add(context_t *ctx, toml_table_t *tab, int entry) {
+  int nkey = tab->nkval + tab->narr + tab->ntab;
+  int i;
+
+  if (nkey <= TOML_INDEX_MIN)
+    return 0;
+
+  if (nkey * 2 <= tab->nindex) {
+    index_put(tab, entry);
+    return 0;
+  }
+
+  int nindex = tab->nindex ? tab->nindex * 2 : 4 * TOML_INDEX_MIN;
+  int *index = (int *)ctx_calloc(ctx, nindex, sizeof(int));
+  if (!index)
+    return -1;
+  ctx_free(ctx, tab->index);
+  tab->index = index;
+  tab->nindex = nindex;
+
+  for (i = 0; i < tab->nkval; i++)
+    index_put(tab, INDEX_ENTRY(INDEX_KVAL, i));
+  for (i = 0; i < tab->narr; i++)
+    index_put(tab, INDEX_ENTRY(INDEX_ARR, i));
+  for (i = 0; i < tab->ntab; i++)
+    index_put(tab, INDEX_ENTRY(INDEX_TAB, i));
+  return 0;
+}
+
+/*
+ * Find key in tab. Return 0 if not found, or an entry as made by
+ * INDEX_ENTRY().
+ */
+static int find_key(const toml_table_t *tab, const char *key) {
+  int i;
+
+  if (tab->index) {
+    unsigned mask = (unsigned)tab->nindex - 1;
+    for (i = (int)(key_hash(key) & mask); tab->index[i];
+         i = (int)((i + 1) & mask)) {
+      if (0 == strcmp(key, index_key(tab, tab->index[i])))
+        return tab->index[i];
+    }
+    return 0;
+  }
+
+  for (i = 0; i < tab->nkval; i++) {
+    if (0 == strcmp(key, tab->kval[i]->key))
+      return INDEX_ENTRY(INDEX_KVAL, i);
+  }
+  for (i = 0; i < tab->narr; i++) {
+    if (0 == strcmp(key, tab->arr[i]->key))
+      return INDEX_ENTRY(INDEX_ARR, i);
+  }
+  for (i = 0; i < tab->ntab; i++) {
+    if (0 == strcmp(key, tab->tab[i]->key))
+      return INDEX_ENTRY(INDEX_TAB, i);
+  }
+  return 0;
+}
+
 /*
  * Look up key in tab. Return 0 if not found, or
  * 'v'alue, 'a'rray or 't'able depending on the element.
@@ -692,7 +982,7 @@ static char *normalize_key(context_t *ctx, token_t strtok) {
 static int check_key(toml_table_t *tab, const char *key,
                      toml_keyval_t **ret_val, toml_array_t **ret_arr,
                      toml_table_t **ret_tab) {
-  int i;
+  int entry = find_key(tab, key);
   void *dummy;
 
   if (!ret_tab)
@@ -706,25 +996,19 @@ static int check_key(toml_table_t *tab, const char *key,
   *ret_arr = 0;
   *ret_val = 0;
 
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key)) {
-      *ret_val = tab->kval[i];
-      return 'v';
-    }
-  }
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key)) {
-      *ret_arr = tab->arr[i];
-      return 'a';
-    }
-  }
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key)) {
-      *ret_tab = tab->tab[i];
-      return 't';
-    }
+  switch (entry & 3) {
+  case INDEX_KVAL:
+    *ret_val = tab->kval[entry >> 2];
+    return 'v';
+  case INDEX_ARR:
+    *ret_arr = tab->arr[entry >> 2];
+    return 'a';
+  case INDEX_TAB:
+    *ret_tab = tab->tab[entry >> 2];
+    return 't';
+  default:
+    return 0;
   }
-  return 0;
 }
 
 static int key_kind(toml_table_t *tab, const char *key) {
@@ -745,7 +1029,7 @@ static toml_keyval_t *create_keyval_in_table(context_t *ctx, toml_table_t *tab,
   /* if key exists: error out. */
   toml_keyval_t *dest = 0;
   if (key_kind(tab, newkey)) {
-    xfree(newkey);
+    ctx_free(ctx, newkey);
     e_keyexists(ctx, keytok.lineno);
     return 0;
   }
@@ -753,15 +1037,15 @@ static toml_keyval_t *create_keyval_in_table(context_t *ctx, toml_table_t *tab,
   /* make a new entry */
   int n = tab->nkval;
   toml_keyval_t **base;
-  if (0 == (base = (toml_keyval_t **)expand_ptrarr((void **)tab->kval, n))) {
-    xfree(newkey);
+  if (0 == (base = (toml_keyval_t **)expand_ptrarr(ctx, (void **)tab->kval, n, &tab->kvalcap))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
   tab->kval = base;
 
-  if (0 == (base[n] = (toml_keyval_t *)CALLOC(1, sizeof(*base[n])))) {
-    xfree(newkey);
+  if (0 == (base[n] = (toml_keyval_t *)ctx_calloc(ctx, 1, sizeof(*base[n])))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
@@ -769,6 +1053,10 @@ static toml_keyval_t *create_keyval_in_table(context_t *ctx, toml_table_t *tab,
 
   /* save the key in the new value struct */
   dest->key = newkey;
+  if (index_add(ctx, tab, INDEX_ENTRY(INDEX_KVAL, n))) {
+    e_outofmemory(ctx, FLINE);
+    return 0;
+  }
   return dest;
 }
 
@@ -786,7 +1074,7 @@ static toml_table_t *create_keytable_in_table(context_t *ctx, toml_table_t *tab,
   /* if key exists: error out */
   toml_table_t *dest = 0;
   if (check_key(tab, newkey, 0, 0, &dest)) {
-    xfree(newkey); /* don't need this anymore */
+    ctx_free(ctx, newkey); /* don't need this anymore */
 
     /* special case: if table exists, but was created implicitly ... */
     if (dest && dest->implicit) {
@@ -801,15 +1089,15 @@ static toml_table_t *create_keytable_in_table(context_t *ctx, toml_table_t *tab,
   /* create a new table entry */
   int n = tab->ntab;
   toml_table_t **base;
-  if (0 == (base = (toml_table_t **)expand_ptrarr((void **)tab->tab, n))) {
-    xfree(newkey);
+  if (0 == (base = (toml_table_t **)expand_ptrarr(ctx, (void **)tab->tab, n, &tab->tabcap))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
   tab->tab = base;
 
-  if (0 == (base[n] = (toml_table_t *)CALLOC(1, sizeof(*base[n])))) {
-    xfree(newkey);
+  if (0 == (base[n] = (toml_table_t *)ctx_calloc(ctx, 1, sizeof(*base[n])))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
@@ -817,6 +1105,10 @@ static toml_table_t *create_keytable_in_table(context_t *ctx, toml_table_t *tab,
 
   /* save the key in the new table struct */
   dest->key = newkey;
+  if (index_add(ctx, tab, INDEX_ENTRY(INDEX_TAB, n))) {
+    e_outofmemory(ctx, FLINE);
+    return 0;
+  }
   return dest;
 }
 
@@ -833,7 +1125,7 @@ static toml_array_t *create_keyarray_in_table(context_t *ctx, toml_table_t *tab,
 
   /* if key exists: error out */
   if (key_kind(tab, newkey)) {
-    xfree(newkey); /* don't need this anymore */
+    ctx_free(ctx, newkey); /* don't need this anymore */
     e_keyexists(ctx, keytok.lineno);
     return 0;
   }
@@ -841,15 +1133,15 @@ static toml_array_t *create_keyarray_in_table(context_t *ctx, toml_table_t *tab,
   /* make a new array entry */
   int n = tab->narr;
   toml_array_t **base;
-  if (0 == (base = (toml_array_t **)expand_ptrarr((void **)tab->arr, n))) {
-    xfree(newkey);
+  if (0 == (base = (toml_array_t **)expand_ptrarr(ctx, (void **)tab->arr, n, &tab->arrcap))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
   tab->arr = base;
 
-  if (0 == (base[n] = (toml_array_t *)CALLOC(1, sizeof(*base[n])))) {
-    xfree(newkey);
+  if (0 == (base[n] = (toml_array_t *)ctx_calloc(ctx, 1, sizeof(*base[n])))) {
+    ctx_free(ctx, newkey);
     e_outofmemory(ctx, FLINE);
     return 0;
   }
@@ -858,13 +1150,17 @@ static toml_array_t *create_keyarray_in_table(context_t *ctx, toml_table_t *tab,
   /* save the key in the new array struct */
   dest->key = newkey;
   dest->kind = kind;
+  if (index_add(ctx, tab, INDEX_ENTRY(INDEX_ARR, n))) {
+    e_outofmemory(ctx, FLINE);
+    return 0;
+  }
   return dest;
 }
 
 static toml_arritem_t *create_value_in_array(context_t *ctx,
                                              toml_array_t *parent) {
   const int n = parent->nitem;
-  toml_arritem_t *base = expand_arritem(parent->item, n);
+  toml_arritem_t *base = expand_arritem(ctx, parent->item, n, &parent->itemcap);
   if (!base) {
     e_outofmemory(ctx, FLINE);
     return 0;
@@ -879,12 +1175,12 @@ static toml_arritem_t *create_value_in_array(context_t *ctx,
 static toml_array_t *create_array_in_array(context_t *ctx,
                                            toml_array_t *parent) {
   const int n = parent->nitem;
-  toml_arritem_t *base = expand_arritem(parent->item, n);
+  toml_arritem_t *base = expand_arritem(ctx, parent->item, n, &parent->itemcap);
   if (!base) {
     e_outofmemory(ctx, FLINE);
     return 0;
   }
-  toml_array_t *ret = (toml_array_t *)CALLOC(1, sizeof(toml_array_t));
+  toml_array_t *ret = (toml_array_t *)ctx_calloc(ctx, 1, sizeof(toml_array_t));
   if (!ret) {
     e_outofmemory(ctx, FLINE);
     return 0;
@@ -900,12 +1196,12 @@ static toml_array_t *create_array_in_array(context_t *ctx,
 static toml_table_t *create_table_in_array(context_t *ctx,
                                            toml_array_t *parent) {
   int n = parent->nitem;
-  toml_arritem_t *base = expand_arritem(parent->item, n);
+  toml_arritem_t *base = expand_arritem(ctx, parent->item, n, &parent->itemcap);
   if (!base) {
     e_outofmemory(ctx, FLINE);
     return 0;
   }
-  toml_table_t *ret = (toml_table_t *)CALLOC(1, sizeof(toml_table_t));
+  toml_table_t *ret = (toml_table_t *)ctx_calloc(ctx, 1, sizeof(toml_table_t));
   if (!ret) {
     e_outofmemory(ctx, FLINE);
     return 0;
@@ -1031,7 +1327,11 @@ static int parse_array(context_t *ctx, toml_array_t *arr) {
       if (!newval)
         return e_outofmemory(ctx, FLINE);
 
-      if (!(newval->val = STRNDUP(val, vlen)))
+      /* move past the value before taking its text */
+      if (eat_token(ctx, STRING, 0, FLINE))
+        return -1;
+
+      if (!(newval->val = token_text(ctx, val, vlen)))
         return e_outofmemory(ctx, FLINE);
 
       newval->valtype = valtype(newval->val);
@@ -1041,9 +1341,6 @@ static int parse_array(context_t *ctx, toml_array_t *arr) {
         arr->type = newval->valtype;
       else if (arr->type != newval->valtype)
         arr->type = 'm'; /* mixed */
-
-      if (eat_token(ctx, STRING, 0, FLINE))
-        return -1;
       break;
     }
 
@@ -1126,7 +1423,7 @@ static int parse_keyval(context_t *ctx, toml_table_t *tab) {
         return -1;
 
       subtab = toml_table_in(tab, subtabstr);
-      xfree(subtabstr);
+      ctx_free(ctx, subtabstr);
     }
     if (!subtab) {
       subtab = create_keytable_in_table(ctx, tab, key);
@@ -1154,13 +1451,14 @@ static int parse_keyval(context_t *ctx, toml_table_t *tab) {
       return -1;
     token_t val = ctx->tok;
 
-    assert(keyval->val == 0);
-    if (!(keyval->val = STRNDUP(val.ptr, val.len)))
-      return e_outofmemory(ctx, FLINE);
-
+    /* move past the value before taking its text */
     if (next_token(ctx, 1))
       return -1;
 
+    assert(keyval->val == 0);
+    if (!(keyval->val = token_text(ctx, val.ptr, val.len)))
+      return e_outofmemory(ctx, FLINE);
+
     return 0;
   }
 
@@ -1205,7 +1503,7 @@ static int fill_tabpath(context_t *ctx) {
   /* clear tpath */
   for (i = 0; i < ctx->tpath.top; i++) {
     char **p = &ctx->tpath.key[i];
-    xfree(*p);
+    ctx_free(ctx, *p);
     *p = 0;
   }
   ctx->tpath.top = 0;
@@ -1218,16 +1516,18 @@ static int fill_tabpath(context_t *ctx) {
     if (ctx->tok.tok != STRING)
       return e_syntax(ctx, lineno, "invalid or missing key");
 
-    char *key = normalize_key(ctx, ctx->tok);
+    /* move past the key before normalizing it */
+    token_t keytok = ctx->tok;
+    if (next_token(ctx, 1))
+      return -1;
+
+    char *key = normalize_key(ctx, keytok);
     if (!key)
       return -1;
-    ctx->tpath.tok[ctx->tpath.top] = ctx->tok;
+    ctx->tpath.tok[ctx->tpath.top] = keytok;
     ctx->tpath.key[ctx->tpath.top] = key;
     ctx->tpath.top++;
 
-    if (next_token(ctx, 1))
-      return -1;
-
     if (ctx->tok.tok == RBRACKET)
       break;
 
@@ -1279,19 +1579,23 @@ static int walk_tabpath(context_t *ctx) {
     default: { /* Not found. Let's create an implicit table. */
       int n = curtab->ntab;
       toml_table_t **base =
-          (toml_table_t **)expand_ptrarr((void **)curtab->tab, n);
+          (toml_table_t **)expand_ptrarr(ctx, (void **)curtab->tab, n,
+                                         &curtab->tabcap);
       if (0 == base)
         return e_outofmemory(ctx, FLINE);
 
       curtab->tab = base;
 
-      if (0 == (base[n] = (toml_table_t *)CALLOC(1, sizeof(*base[n]))))
+      if (0 == (base[n] = (toml_table_t *)ctx_calloc(ctx, 1, sizeof(*base[n]))))
         return e_outofmemory(ctx, FLINE);
 
-      if (0 == (base[n]->key = STRDUP(key)))
+      /* the key of a parse in place stays where it is */
+      if (0 == (base[n]->key = ctx->arena ? key : STRDUP(key)))
         return e_outofmemory(ctx, FLINE);
 
       nexttab = curtab->tab[curtab->ntab++];
+      if (index_add(ctx, curtab, INDEX_ENTRY(INDEX_TAB, n)))
+        return e_outofmemory(ctx, FLINE);
 
       /* tabs created by walk_tabpath are considered implicit */
       nexttab->implicit = true;
@@ -1332,7 +1636,7 @@ static int parse_select(context_t *ctx) {
   /* For [x.y.z] or [[x.y.z]], remove z from tpath.
    */
   token_t z = ctx->tpath.tok[ctx->tpath.top - 1];
-  xfree(ctx->tpath.key[ctx->tpath.top - 1]);
+  ctx_free(ctx, ctx->tpath.key[ctx->tpath.top - 1]);
   ctx->tpath.top--;
 
   /* set up ctx->curtab */
@@ -1353,7 +1657,7 @@ static int parse_select(context_t *ctx) {
       if (!zstr)
         return -1;
       arr = toml_array_in(ctx->curtab, zstr);
-      xfree(zstr);
+      ctx_free(ctx, zstr);
     }
     if (!arr) {
       arr = create_keyarray_in_table(ctx, ctx->curtab, z, 't');
@@ -1370,7 +1674,7 @@ static int parse_select(context_t *ctx) {
       if (!t)
         return -1;
 
-      if (0 == (t->key = STRDUP("__anon__")))
+      if (0 == (t->key = ctx_strndup(ctx, "__anon__", 8)))
         return e_outofmemory(ctx, FLINE);
 
       dest = t;
@@ -1399,7 +1703,13 @@ static int parse_select(context_t *ctx) {
   return 0;
 }
 
-toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
+/*
+ * Parse conf. Given an arena, everything is allocated from it, keys and
+ * values are left in conf, and the root table keeps the arena, which is
+ * freed on failure.
+ */
+static toml_table_t *parse(char *conf, toml_arena_t *arena, char *errbuf,
+                           int errbufsz) {
   context_t ctx;
 
   // clear errbuf
@@ -1414,6 +1724,7 @@ toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
   ctx.stop = ctx.start + strlen(conf);
   ctx.errbuf = errbuf;
   ctx.errbufsz = errbufsz;
+  ctx.arena = arena;
 
   // start with an artificial newline of length 0
   ctx.tok.tok = NEWLINE;
@@ -1422,10 +1733,9 @@ toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
   ctx.tok.len = 0;
 
   // make a root table
-  if (0 == (ctx.root = CALLOC(1, sizeof(*ctx.root)))) {
+  if (0 == (ctx.root = ctx_calloc(&ctx, 1, sizeof(*ctx.root)))) {
     e_outofmemory(&ctx, FLINE);
-    // Do not goto fail, root table not set up yet
-    return 0;
+    goto fail;
   }
 
   // set root as default table
@@ -1466,28 +1776,80 @@ toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
 
   /* success */
   for (int i = 0; i < ctx.tpath.top; i++)
-    xfree(ctx.tpath.key[i]);
+    ctx_free(&ctx, ctx.tpath.key[i]);
+  ctx.root->arena = arena;
   return ctx.root;
 
 fail:
   // Something bad has happened. Free resources and return error.
   for (int i = 0; i < ctx.tpath.top; i++)
-    xfree(ctx.tpath.key[i]);
-  toml_free(ctx.root);
+    ctx_free(&ctx, ctx.tpath.key[i]);
+  if (arena)
+    arena_free(arena);
+  else
+    toml_free(ctx.root);
   return 0;
 }
 
-toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
+toml_table_t *toml_parse(char *conf, char *errbuf, int errbufsz) {
+  return parse(conf, 0, errbuf, errbufsz);
+}
+
+toml_table_t *toml_parse_inplace(char *conf, char *errbuf, int errbufsz) {
+  toml_arena_t *arena = arena_new(strlen(conf), 0, 0);
+  if (!arena) {
+    snprintf(errbuf, errbufsz, "out of memory");
+    return 0;
+  }
+  return parse(conf, arena, errbuf, errbufsz);
+}
+
+toml_table_t *toml_parse_with_mem(const char *conf, char *errbuf,
+                                  int errbufsz,
+                                  void *(*xxcalloc)(size_t, size_t),
+                                  void (*xxfree)(void *)) {
+  size_t len = strlen(conf);
+  /* room for the copy and for about as much again of tables */
+  toml_arena_t *arena = arena_new(2 * len + 1, xxcalloc, xxfree);
+  char *copy = arena ? arena_alloc(arena, len + 1) : 0;
+  if (!copy) {
+    if (arena)
+      arena_free(arena);
+    snprintf(errbuf, errbufsz, "out of memory");
+    return 0;
+  }
+  memcpy(copy, conf, len + 1);
+  return parse(copy, arena, errbuf, errbufsz);
+}
+
+/*
+ * Read the rest of fp into a NUL terminated buffer, to be freed with
+ * xfree(). Return 0 on error.
+ */
+static char *read_file(FILE *fp, char *errbuf, int errbufsz) {
   int bufsz = 0;
   char *buf = 0;
   int off = 0;
+  struct stat st;
+
+  /* size the buffer to the rest of a regular file, so that it is read
+   * with a single fread(); anything else is read in doubling chunks */
+  if (0 == fstat(fileno(fp), &st) && S_ISREG(st.st_mode)) {
+    long pos = ftell(fp);
+    if (pos >= 0 && st.st_size >= pos && st.st_size - pos < INT_MAX)
+      bufsz = (int)(st.st_size - pos) + 1;
+  }
+  if (bufsz && 0 == (buf = MALLOC(bufsz))) {
+    snprintf(errbuf, errbufsz, "out of memory");
+    return 0;
+  }
 
   /* read from fp into buf */
   while (!feof(fp)) {
 
     if (off == bufsz) {
-      int xsz = bufsz + 1000;
-      char *x = expand(buf, bufsz, xsz);
+      int xsz = bufsz ? bufsz * 2 : 4096;
+      char *x = bufsz <= INT_MAX / 2 ? expand(buf, bufsz, xsz) : 0;
       if (!x) {
         snprintf(errbuf, errbufsz, "out of memory");
         xfree(buf);
@@ -1521,6 +1883,13 @@ toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
     bufsz = xsz;
   }
   buf[off] = 0;
+  return buf;
+}
+
+toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
+  char *buf = read_file(fp, errbuf, errbufsz);
+  if (!buf)
+    return 0;
 
   /* parse it, cleanup and finish */
   toml_table_t *ret = toml_parse(buf, errbuf, errbufsz);
@@ -1528,6 +1897,22 @@ toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz) {
   return ret;
 }
 
+toml_table_t *toml_parse_file_inplace(FILE *fp, char *errbuf, int errbufsz) {
+  char *buf = read_file(fp, errbuf, errbufsz);
+  if (!buf)
+    return 0;
+
+  /* the arena owns the buffer from here on */
+  toml_arena_t *arena = arena_new(strlen(buf), 0, 0);
+  if (!arena) {
+    snprintf(errbuf, errbufsz, "out of memory");
+    xfree(buf);
+    return 0;
+  }
+  arena->source = buf;
+  return parse(buf, arena, errbuf, errbufsz);
+}
+
 static void xfree_kval(toml_keyval_t *p) {
   if (!p)
     return;
@@ -1538,6 +1923,19 @@ static void xfree_kval(toml_keyval_t *p) {
 
 static void xfree_tab(toml_table_t *p);
 
+static void xfree_value(toml_value_t *p, int n) {
+  if (!p)
+    return;
+
+  for (int i = 0; i < n; i++) {
+    if (p[i].type == 's')
+      xfree(p[i].u.s);
+    else if (p[i].type == 't' || p[i].type == 'D' || p[i].type == 'T')
+      xfree(p[i].u.ts);
+  }
+  xfree(p);
+}
+
 static void xfree_arr(toml_array_t *p) {
   if (!p)
     return;
@@ -1554,6 +1952,7 @@ static void xfree_arr(toml_array_t *p) {
       xfree_tab(a->tab);
   }
   xfree(p->item);
+  xfree_value(p->value, p->nitem);
   xfree(p);
 }
 
@@ -1577,10 +1976,18 @@ static void xfree_tab(toml_table_t *p) {
     xfree_tab(p->tab[i]);
   xfree(p->tab);
 
+  xfree(p->index);
+  xfree_value(p->value, p->nkval);
+
   xfree(p);
 }
 
-void toml_free(toml_table_t *tab) { xfree_tab(tab); }
+void toml_free(toml_table_t *tab) {
+  if (tab && tab->arena)
+    arena_free(tab->arena);
+  else
+    xfree_tab(tab);
+}
 
 static void set_token(context_t *ctx, tokentype_t tok, int lineno, char *ptr,
                       int len) {
@@ -1805,10 +2212,16 @@ static int next_token(context_t *ctx, int dotisspecial) {
   char *p = ctx->tok.ptr;
   int i;
 
-  /* eat this tok */
-  for (i = 0; i < ctx->tok.len; i++) {
-    if (*p++ == '\n')
-      lineno++;
+  /* eat this tok. The '\n' of a NEWLINE may have been overwritten by
+   * token_text(), so count it by type. */
+  if (ctx->tok.tok == NEWLINE) {
+    lineno += ctx->tok.len;
+    p += ctx->tok.len;
+  } else {
+    for (i = 0; i < ctx->tok.len; i++) {
+      if (*p++ == '\n')
+        lineno++;
+    }
   }
 
   /* make next tok */
@@ -1878,47 +2291,22 @@ const char *toml_key_in(const toml_table_t *tab, int keyidx) {
 }
 
 int toml_key_exists(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key))
-      return 1;
-  }
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key))
-      return 1;
-  }
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key))
-      return 1;
-  }
-  return 0;
+  return find_key(tab, key) != 0;
 }
 
 toml_raw_t toml_raw_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->nkval; i++) {
-    if (0 == strcmp(key, tab->kval[i]->key))
-      return tab->kval[i]->val;
-  }
-  return 0;
+  int entry = find_key(tab, key);
+  return (entry & 3) == INDEX_KVAL ? tab->kval[entry >> 2]->val : 0;
 }
 
 toml_array_t *toml_array_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->narr; i++) {
-    if (0 == strcmp(key, tab->arr[i]->key))
-      return tab->arr[i];
-  }
-  return 0;
+  int entry = find_key(tab, key);
+  return (entry & 3) == INDEX_ARR ? tab->arr[entry >> 2] : 0;
 }
 
 toml_table_t *toml_table_in(const toml_table_t *tab, const char *key) {
-  int i;
-  for (i = 0; i < tab->ntab; i++) {
-    if (0 == strcmp(key, tab->tab[i]->key))
-      return tab->tab[i];
-  }
-  return 0;
+  int entry = find_key(tab, key);
+  return (entry & 3) == INDEX_TAB ? tab->tab[entry >> 2] : 0;
 }
 
 toml_raw_t toml_raw_at(const toml_array_t *arr, int idx) {
@@ -2381,6 +2769,121 @@ toml_datum_t toml_timestamp_in(const toml_table_t *arr, const char *key) {
   return ret;
 }
 
+/*
+ * Allocation for toml_decode(): from the arena of a table parsed in
+ * place, else from the heap.
+ */
+static void *decode_alloc(toml_arena_t *arena, size_t n) {
+  void *p = arena ? arena_alloc(arena, n) : MALLOC(n);
+  if (p)
+    memset(p, 0, n);
+  return p;
+}
+
+static int decode_raw(toml_arena_t *arena, toml_raw_t raw, toml_value_t *v) {
+  toml_timestamp_t ts;
+  char *s;
+
+  v->type = 0;
+  if (*raw == '\'' || *raw == '"') {
+    if (toml_rtos(raw, &s))
+      return 0;
+    if (arena) {
+      size_t len = strlen(s) + 1;
+      char *copy = arena_alloc(arena, len);
+      if (copy)
+        memcpy(copy, s, len);
+      xfree(s);
+      if (!copy)
+        return -1;
+      s = copy;
+    }
+    v->u.s = s;
+    v->type = 's';
+  } else if (0 == toml_rtob(raw, &v->u.b)) {
+    v->type = 'b';
+  } else if (0 == toml_rtoi(raw, &v->u.i)) {
+    v->type = 'i';
+  } else if (0 == toml_rtod(raw, &v->u.d)) {
+    v->type = 'd';
+  } else if (0 == toml_rtots(raw, &ts)) {
+    /* decode again in place, so its fields point into its own buffer */
+    toml_timestamp_t *p = decode_alloc(arena, sizeof(*p));
+    if (!p)
+      return -1;
+    toml_rtots(raw, p);
+    v->u.ts = p;
+    v->type = ts.year ? (ts.hour ? 'T' : 'D') : 't';
+  }
+  return 0;
+}
+
+static int decode_array(toml_arena_t *arena, toml_array_t *arr);
+
+static int decode_table(toml_arena_t *arena, toml_table_t *tab) {
+  int i;
+
+  if (tab->nkval && !tab->value) {
+    tab->value = decode_alloc(arena, tab->nkval * sizeof(toml_value_t));
+    if (!tab->value)
+      return -1;
+    for (i = 0; i < tab->nkval; i++) {
+      if (decode_raw(arena, tab->kval[i]->val, &tab->value[i]))
+        return -1;
+    }
+  }
+  for (i = 0; i < tab->narr; i++) {
+    if (decode_array(arena, tab->arr[i]))
+      return -1;
+  }
+  for (i = 0; i < tab->ntab; i++) {
+    if (decode_table(arena, tab->tab[i]))
+      return -1;
+  }
+  return 0;
+}
+
+static int decode_array(toml_arena_t *arena, toml_array_t *arr) {
+  int i;
+
+  if ((arr->kind == 'v' || arr->kind == 'm') && arr->nitem && !arr->value) {
+    arr->value = decode_alloc(arena, arr->nitem * sizeof(toml_value_t));
+    if (!arr->value)
+      return -1;
+    for (i = 0; i < arr->nitem; i++) {
+      if (arr->item[i].val &&
+          decode_raw(arena, arr->item[i].val, &arr->value[i]))
+        return -1;
+    }
+  }
+  for (i = 0; i < arr->nitem; i++) {
+    toml_arritem_t *item = &arr->item[i];
+    if (item->arr) {
+      if (decode_array(arena, item->arr))
+        return -1;
+    } else if (item->tab) {
+      if (decode_table(arena, item->tab))
+        return -1;
+    }
+  }
+  return 0;
+}
+
+int toml_decode(toml_table_t *tab) { return decode_table(tab->arena, tab); }
+
+const toml_value_t *toml_value_in(const toml_table_t *tab, const char *key) {
+  int entry = find_key(tab, key);
+  if ((entry & 3) != INDEX_KVAL || !tab->value)
+    return 0;
+  return &tab->value[entry >> 2];
+}
+
+const toml_value_t *toml_value_at(const toml_array_t *arr, int idx) {
+  if (!arr->value || idx < 0 || idx >= arr->nitem || !arr->item[idx].val)
+    return 0;
+  return &arr->value[idx];
+}
+
 static int parse_millisec(const char *p, const char **endp) {
   int ret = 0;
   int unit = 100; /* unit in millisec */
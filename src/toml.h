@@ -32,16 +32,19 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include "cssg_export.h"
+
 #ifdef __cplusplus
-#define TOML_EXTERN extern "C"
+#define TOML_EXTERN extern "C" CSSG_EXPORT
 #else
-#define TOML_EXTERN extern
+#define TOML_EXTERN extern CSSG_EXPORT
 #endif
 
 typedef struct toml_timestamp_t toml_timestamp_t;
 typedef struct toml_table_t toml_table_t;
 typedef struct toml_array_t toml_array_t;
 typedef struct toml_datum_t toml_datum_t;
+typedef struct toml_value_t toml_value_t;
 
 /* Parse a file. Return a table on success, or 0 otherwise.
  * Caller must toml_free(the-return-value) after use.
@@ -55,7 +58,30 @@ TOML_EXTERN toml_table_t *toml_parse_file(FILE *fp, char *errbuf, int errbufsz);
 TOML_EXTERN toml_table_t *toml_parse(char *conf, /* NUL terminated, please. */
                                      char *errbuf, int errbufsz);
 
-/* Free the table returned by toml_parse() or toml_parse_file(). Once
+/* Parse like toml_parse(), but leave keys and raw values in conf instead
+ * of copying them: conf is changed in place and must outlive the table.
+ * Everything else comes from a few large blocks, which toml_free()
+ * releases at once.
+ */
+TOML_EXTERN toml_table_t *toml_parse_inplace(char *conf, char *errbuf,
+                                             int errbufsz);
+
+/* Parse a copy of conf like toml_parse_inplace(). The copy and the
+ * blocks of the table come from xxcalloc, and toml_free() gives them
+ * back to xxfree, which may be 0 if their owner releases them at once.
+ */
+TOML_EXTERN toml_table_t *toml_parse_with_mem(const char *conf, char *errbuf,
+                                              int errbufsz,
+                                              void *(*xxcalloc)(size_t, size_t),
+                                              void (*xxfree)(void *));
+
+/* Parse a file like toml_parse_inplace(). The table keeps the contents
+ * of the file until toml_free().
+ */
+TOML_EXTERN toml_table_t *toml_parse_file_inplace(FILE *fp, char *errbuf,
+                                                  int errbufsz);
+
+/* Free the table returned by any of the toml_parse functions. Once
  * this function is called, any handles accessed through this tab
  * directly or indirectly are no longer valid.
  */
@@ -123,6 +149,40 @@ TOML_EXTERN toml_array_t *toml_array_in(const toml_table_t *tab,
 TOML_EXTERN toml_table_t *toml_table_in(const toml_table_t *tab,
                                         const char *key);
 
+/*-----------------------------------------------------------------
+ *  Decoded values
+ *
+ *  toml_decode() decodes every value of a parsed table once. The
+ *  values are then read with toml_value_in() and toml_value_at(),
+ *  without parsing or allocating on each call.
+ */
+struct toml_value_t {
+  /* i:int, d:double, b:bool, s:string, t:time, D:date, T:timestamp,
+     0 if the value could not be decoded */
+  char type;
+  union {
+    const char *s;              /* string value, owned by the table */
+    const toml_timestamp_t *ts; /* timestamp value, owned by the table */
+    int b;                      /* bool value */
+    int64_t i;                  /* int value */
+    double d;                   /* double value */
+  } u;
+};
+
+/* Decode the values of tab and of the tables and arrays in it. Call it
+ * on the table returned by a toml_parse function, before the table is
+ * shared between threads. Return 0 on success, -1 if out of memory.
+ */
+TOML_EXTERN int toml_decode(toml_table_t *tab);
+
+/* Return the decoded value of key or element idx, or 0 if there is no
+ * such value or it was not decoded.
+ */
+TOML_EXTERN const toml_value_t *toml_value_in(const toml_table_t *tab,
+                                              const char *key);
+TOML_EXTERN const toml_value_t *toml_value_at(const toml_array_t *arr,
+                                              int idx);
+
 /*-----------------------------------------------------------------
  * lesser used
  */
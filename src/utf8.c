@@ -1,8 +1,10 @@
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <assert.h>
 
 #include "cssg_ctype.h"
+#include "simd.h"
 #include "utf8.h"
 
 static const int8_t utf8proc_utf8class[256] = {
@@ -220,45 +222,53 @@ void cssg_utf8proc_encode_char(int32_t uc, cssg_strbuf *buf) {
 
 #include "case_fold.inc"
 
-int cf_compare(const void *v1, const void *v2) {
-  uint32_t entry1 = *(uint32_t *) v1;
-  uint32_t entry2 = *(uint32_t *) v2;
-
-  return (int32_t) CF_CODE_POINT(entry1) - (int32_t) CF_CODE_POINT(entry2);
-}
-
-void cssg_utf8proc_case_fold(cssg_strbuf *dest, const uint8_t *str,
-                              bufsize_t len) {
+bufsize_t cssg_utf8proc_case_fold_into(uint8_t *dst, const uint8_t *str,
+                                       bufsize_t len) {
+  static const uint8_t repl[] = {239, 191, 189};
+  uint8_t *out = dst;
   int32_t c;
 
   while (len > 0) {
-    bufsize_t char_len = cssg_utf8proc_iterate(str, len, &c);
-
-    if (char_len == 1) {
-      if (c >= 'A' && c <= 'Z')
-        c += 'a' - 'A';
-      cssg_strbuf_putc(dest, c);
-    } else if (c >= CF_MAX) {
-        cssg_strbuf_put(dest, str, char_len);
-    } else if (char_len >= 0) {
-      uint32_t key = c;
-      uint32_t *entry = bsearch(&key, cf_table,
-                                CF_TABLE_SIZE, sizeof(uint32_t),
-                                cf_compare);
-      if (entry == NULL) {
-        cssg_strbuf_put(dest, str, char_len);
+    bufsize_t char_len;
+
+    if (*str < 0x80) {
+      bufsize_t n = cssg_ascii_lower(out, str, len);
+      out += n;
+      str += n;
+      len -= n;
+      continue;
+    }
+
+    char_len = cssg_utf8proc_iterate(str, len, &c);
+    if (char_len < 0) {
+      memcpy(out, repl, 3);
+      out += 3;
+      char_len = -char_len;
+    } else {
+      uint16_t entry = c < CF_MAX ? CF_LOOKUP(c) : 0;
+      if (entry) {
+        memcpy(out, cf_repl + CF_REPL_IDX(entry), CF_REPL_SIZE(entry));
+        out += CF_REPL_SIZE(entry);
       } else {
-        cssg_strbuf_put(dest, cf_repl + CF_REPL_IDX(*entry),
-                         CF_REPL_SIZE(*entry));
+        memcpy(out, str, char_len);
+        out += char_len;
       }
-    } else {
-      encode_unknown(dest);
-      char_len = -char_len;
     }
 
     str += char_len;
     len -= char_len;
   }
+
+  return (bufsize_t)(out - dst);
+}
+
+void cssg_utf8proc_case_fold(cssg_strbuf *dest, const uint8_t *str,
+                              bufsize_t len) {
+  if (len <= 0)
+    return;
+  cssg_strbuf_grow(dest, dest->size + CSSG_CASE_FOLD_MAX_GROWTH * len);
+  dest->size += cssg_utf8proc_case_fold_into(dest->ptr + dest->size, str, len);
+  dest->ptr[dest->size] = '\0';
 }
 
 // matches anything in the Zs class, plus LF, CR, TAB, FF.
@@ -8,8 +8,15 @@
 extern "C" {
 #endif
 
+// Case folding never makes a string more than this many times longer.
+#define CSSG_CASE_FOLD_MAX_GROWTH 3
+
 void cssg_utf8proc_case_fold(cssg_strbuf *dest, const uint8_t *str,
                               bufsize_t len);
+// Case folds str into dst, which must have room for
+// CSSG_CASE_FOLD_MAX_GROWTH * len bytes, and returns the bytes written.
+bufsize_t cssg_utf8proc_case_fold_into(uint8_t *dst, const uint8_t *str,
+                                       bufsize_t len);
 void cssg_utf8proc_encode_char(int32_t uc, cssg_strbuf *buf);
 int cssg_utf8proc_iterate(const uint8_t *str, bufsize_t str_len, int32_t *dst);
 void cssg_utf8proc_check(cssg_strbuf *dest, const uint8_t *line,
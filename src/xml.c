@@ -7,6 +7,7 @@
 #include "cssg.h"
 #include "node.h"
 #include "buffer.h"
+#include "iterator.h"
 
 #define BUFFER_SIZE 100
 #define MAX_INDENT 40
@@ -212,18 +213,20 @@ char *cssg_render_xml(cssg_node *root, int options) {
   cssg_event_type ev_type;
   cssg_node *cur;
   struct render_state state = {&xml, 0};
+  bufsize_t per_node = CSSG_OPT_SOURCEPOS & options ? 88 : 48;
+  cssg_iter iter;
 
-  cssg_iter *iter = cssg_iter_new(root);
-
+  cssg_strbuf_reserve(&xml, 128 + cssg_node_estimate_output(root, per_node,
+                                                            per_node));
   cssg_strbuf_puts(state.xml, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n");
   cssg_strbuf_puts(state.xml,
                     "<!DOCTYPE document SYSTEM \"CommonMark.dtd\">\n");
-  while ((ev_type = cssg_iter_next(iter)) != CSSG_EVENT_DONE) {
-    cur = cssg_iter_get_node(iter);
+  cssg_iter_init(&iter, root);
+  while ((ev_type = cssg_iter_step(&iter)) != CSSG_EVENT_DONE) {
+    cur = iter.cur.node;
     S_render_node(cur, ev_type, &state, options);
   }
   result = (char *)cssg_strbuf_detach(&xml);
 
-  cssg_iter_free(iter);
   return result;
 }
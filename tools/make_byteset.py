@@ -0,0 +1,47 @@
+# Creates the nibble lookup tables for a cssg_byteset (src/simd.h).
+# Byte c is in the set iff (lo[c & 0x0F] & hi[c >> 4]) != 0, which
+# holds exactly as long as the members use at most 8 distinct high
+# nibbles. Only ASCII members are supported.
+# Usage: python3 tools/make_byteset.py NAME 'chars'
+# e.g.:  python3 tools/make_byteset.py LINE_END_SET '\r\n\0'
+
+import sys
+
+if len(sys.argv) != 3:
+    sys.exit("usage: make_byteset.py NAME CHARS")
+
+name = sys.argv[1]
+chars = sys.argv[2].encode('ascii').decode('unicode_escape').encode('latin-1')
+members = sorted(set(chars))
+
+if any(c >= 0x80 for c in members):
+    raise Exception("only ASCII bytes are supported")
+
+groups = sorted(set(c >> 4 for c in members))
+if len(groups) > 8:
+    raise Exception("too many distinct high nibbles")
+
+bit = {h: 1 << i for (i, h) in enumerate(groups)}
+hi = [bit.get(h, 0) for h in range(16)]
+lo = [0] * 16
+for c in members:
+    lo[c & 0x0F] |= bit[c >> 4]
+
+for c in range(256):
+    if ((lo[c & 0x0F] & hi[c >> 4]) != 0) != (c in members):
+        raise Exception("byte 0x%02X misclassified" % c)
+
+def c_char(c):
+    escapes = {0: '\\0', 9: '\\t', 10: '\\n', 13: '\\r', 34: '\\"',
+               92: '\\\\'}
+    return escapes.get(c, chr(c))
+
+def rows(t):
+    return (", ".join("0x%02X" % x for x in t[:8]) + ",\n     " +
+            ", ".join("0x%02X" % x for x in t[8:]))
+
+print("/* \"%s\", generated by tools/make_byteset.py */" %
+      "".join(c_char(c) for c in members).replace("*/", "*\\/"))
+print("static const cssg_byteset %s = {" % name)
+print("    {%s}," % rows(lo))
+print("    {%s}};" % rows(hi))
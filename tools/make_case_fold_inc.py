@@ -57,40 +57,65 @@ if False:
     print("test_result:", test_result)
     sys.exit(0)
 
+# Two-level lookup table: cf_index1 maps each block of 128 code points
+# to a block of cf_index2, whose entries hold the replacement for one
+# code point, or 0 if it does not fold.  Blocks without foldings share
+# block 0.
+BLOCK_BITS = 7
+BLOCK_SIZE = 1 << BLOCK_BITS
+index1 = [0] * ((1 << 17) >> BLOCK_BITS)
+blocks = [(0,) * BLOCK_SIZE]
+block_ids = { blocks[0]: 0 }
+
+entries = {}
+for value in main_table:
+    cp = value & 0x1FFFF
+    # 12 bits for replacement index / 2, 3 bits for size
+    entries[cp] = (value >> 17 & 0xFFF) | (value >> 29) << 12
+
+for b in range(len(index1)):
+    block = tuple(entries.get((b << BLOCK_BITS) + i, 0)
+                  for i in range(BLOCK_SIZE))
+    if block not in block_ids:
+        block_ids[block] = len(blocks)
+        blocks.append(block)
+    index1[b] = block_ids[block]
+
+if len(blocks) > 256:
+    raise Exception("too many blocks")
+
+index2 = [x for block in blocks for x in block]
+
+def print_array(values, per_line, fmt):
+    i = 0
+    size = len(values)
+    for value in values:
+        if i % per_line == 0:
+            print("  ", end="")
+        print(fmt % value, end="")
+        i += 1
+        if i == size: print()
+        elif i % per_line == 0: print(",")
+        else: print(", ", end="")
+
 print("""// Generated by tools/make_case_fold_inc.py
 
 #define CF_MAX            (1 << 17)
-#define CF_TABLE_SIZE     %d
-#define CF_CODE_POINT(x)  ((x) & 0x1FFFF)
-#define CF_REPL_IDX(x)    ((((x) >> 17) & 0xFFF) * 2)
-#define CF_REPL_SIZE(x)   ((x) >> 29)
-
-static const uint32_t cf_table[%d] = {""" % (len(main_table), len(main_table)))
-
-i = 0
-size = len(main_table)
-for value in main_table:
-    if i % 6 == 0:
-        print("  ", end="")
-    print("0x%X" % value, end="")
-    i += 1
-    if i == size: print()
-    elif i % 6 == 0: print(",")
-    else: print(", ", end="")
+#define CF_BLOCK_BITS     %d
+#define CF_LOOKUP(c)      (cf_index2[(cf_index1[(c) >> CF_BLOCK_BITS] \\
+                                      << CF_BLOCK_BITS) | \\
+                                     ((c) & ((1 << CF_BLOCK_BITS) - 1))])
+#define CF_REPL_IDX(x)    (((x) & 0xFFF) * 2)
+#define CF_REPL_SIZE(x)   ((x) >> 12)
+
+static const uint8_t cf_index1[%d] = {""" % (BLOCK_BITS, len(index1)))
+print_array(index1, 16, "%d")
+print("""};
 
+static const uint16_t cf_index2[%d] = {""" % len(index2))
+print_array(index2, 8, "0x%04X")
 print("""};
 
 static const unsigned char cf_repl[%d] = {""" % len(repl_table))
-
-i = 0
-size = len(repl_table)
-for value in repl_table:
-    if i % 12 == 0:
-        print("  ", end="")
-    print("0x%02X" % value, end="")
-    i += 1
-    if i == size: print()
-    elif i % 12 == 0: print(",")
-    else: print(", ", end="")
-
+print_array(repl_table, 12, "0x%02X")
 print("};")
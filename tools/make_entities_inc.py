@@ -1,6 +1,13 @@
-# Creates C data structures for binary lookup table of entities,
+# Creates C data structures for a minimal perfect hash table of entities,
 # using python's html5 entity data.
 # Usage: python3 tools/make_entities_inc.py > src/entities.inc
+#
+# The hash is hash-and-displace: an entity name hashed with seed 0 picks a
+# bucket, and the bucket's displacement is the seed of a second hash that
+# picks the entity's slot in cssg_entities.  Buckets are placed largest
+# first, trying displacements until all of a bucket's names land on free
+# slots.  S_entity_hash() in src/houdini_html_u.c must match hash() below,
+# so change both together.
 
 import html
 
@@ -10,6 +17,41 @@ entities5 = html.entities.html5
 # references without a trailing semicolon.
 entities = sorted([(k[:-1], entities5[k]) for k in entities5.keys() if k[-1] == ';'])
 
+def hash(name, seed):
+    h = (2166136261 ^ seed) & 0xFFFFFFFF
+    for b in name:
+        h ^= b
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+def perfect_hash(names):
+    size = len(names)
+    nbuckets = (size + 3) // 4
+    buckets = [[] for _ in range(nbuckets)]
+    for i, name in enumerate(names):
+        buckets[hash(name, 0) % nbuckets].append(i)
+
+    disp = [0] * nbuckets
+    slots = [None] * size
+    for b in sorted(range(nbuckets), key=lambda b: -len(buckets[b])):
+        if not buckets[b]:
+            break
+        for d in range(1, 1 << 16):
+            placed = [hash(names[i], d) % size for i in buckets[b]]
+            if (len(set(placed)) == len(placed) and
+                    all(slots[s] is None for s in placed)):
+                break
+        else:
+            raise Exception("no displacement found for bucket %d" % b)
+        disp[b] = d
+        for i, s in zip(buckets[b], placed):
+            slots[s] = i
+    return disp, slots
+
+names = [ent.encode('UTF-8') for (ent, repl) in entities]
+disp, slots = perfect_hash(names)
+entities = [entities[i] for i in slots]
+
 main_table = []
 text_table = b''
 text_idx = 0
@@ -32,16 +74,32 @@ for (ent, repl) in entities:
     text_table += ent_bytes + repl_bytes
     text_idx += ent_size + repl_size
 
-print("""/* Autogenerated by tools/make_headers_inc.py */
+print("""/* Autogenerated by tools/make_entities_inc.py */
 
 #define ENT_MIN_LENGTH      2
 #define ENT_MAX_LENGTH      32
 #define ENT_TABLE_SIZE      %d
+#define ENT_BUCKETS         %d
 #define ENT_TEXT_IDX(x)     ((x) & 0x7FFF)
 #define ENT_NAME_SIZE(x)    (((x) >> 15) & 0x1F)
 #define ENT_REPL_SIZE(x)    ((x) >> 20)
 
-static const uint32_t cssg_entities[%d] = {""" % (len(main_table), len(main_table)));
+static const uint16_t cssg_entity_disp[%d] = {""" % (len(main_table), len(disp), len(disp)))
+
+i = 0
+size = len(disp)
+for value in disp:
+    if i % 12 == 0:
+        print("  ", end="")
+    print("%d" % value, end="")
+    i += 1
+    if i == size: print()
+    elif i % 12 == 0: print(",")
+    else: print(", ", end="")
+
+print("""};
+
+static const uint32_t cssg_entities[%d] = {""" % len(main_table))
 
 i = 0
 size = len(main_table)